@@ -0,0 +1,69 @@
+#include "bench.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+
+namespace bench {
+
+static double percentile(const std::vector<double> &sorted, double p) noexcept {
+  const auto rank = p * static_cast<double>(sorted.size() - 1);
+  const auto lower = static_cast<std::size_t>(std::floor(rank));
+  const auto upper = std::min(lower + 1, sorted.size() - 1);
+  const auto fraction = rank - static_cast<double>(lower);
+  return sorted[lower] + (sorted[upper] - sorted[lower]) * fraction;
+}
+
+void Runner::run(std::string_view name, Options options,
+                 const std::function<void()> &fn) {
+  if (name.find(filter) == std::string_view::npos) {
+    return;
+  }
+  // warm up caches, lazily initialized statics and the branch predictor
+  for (auto i = 0uz; i < options.batch; ++i) {
+    fn();
+  }
+
+  std::vector<double> samples{};
+  samples.reserve(options.samples);
+  for (auto s = 0uz; s < options.samples; ++s) {
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0uz; i < options.batch; ++i) {
+      fn();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    samples.push_back(static_cast<double>(elapsed.count()) /
+                      static_cast<double>(options.batch));
+  }
+  std::ranges::sort(samples);
+  const auto total = std::accumulate(samples.begin(), samples.end(), 0.0);
+  results.push_back(Stats{.name = std::string{name},
+                          .samples = samples.size(),
+                          .batch = options.batch,
+                          .min = samples.front(),
+                          .mean = total / static_cast<double>(samples.size()),
+                          .p50 = percentile(samples, 0.50),
+                          .p90 = percentile(samples, 0.90),
+                          .p99 = percentile(samples, 0.99),
+                          .max = samples.back()});
+  std::cerr << std::left << std::setw(40) << name << " p50 " << std::right
+            << std::setw(12) << std::fixed << std::setprecision(1)
+            << results.back().p50 << " ns" << std::endl;
+}
+
+void Runner::writeJson(std::ostream &out) const {
+  out << "{\n  \"unit\": \"ns\",\n  \"benchmarks\": [";
+  auto first = true;
+  for (const auto &r : results) {
+    out << (first ? "\n" : ",\n") << std::fixed << std::setprecision(2)
+        << "    {\"name\": \"" << r.name << "\", \"samples\": " << r.samples
+        << ", \"batch\": " << r.batch << ", \"min\": " << r.min
+        << ", \"mean\": " << r.mean << ", \"p50\": " << r.p50
+        << ", \"p90\": " << r.p90 << ", \"p99\": " << r.p99
+        << ", \"max\": " << r.max << "}";
+    first = false;
+  }
+  out << "\n  ]\n}" << std::endl;
+}
+} // namespace bench
@@ -0,0 +1,52 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bench {
+
+struct Stats {
+  std::string name;
+  std::size_t samples;
+  std::size_t batch;
+  // nanoseconds per call
+  double min, mean, p50, p90, p99, max;
+};
+
+struct Options {
+  // Number of timed samples
+  std::size_t samples{200};
+  // Calls per sample; raise it for calls that are too fast to time alone
+  std::size_t batch{1};
+};
+
+// Runs benchmarks whose name contains the filter and collects their
+// percentiles, so results can be diffed between builds.
+class Runner {
+  std::string_view filter;
+  std::vector<Stats> results{};
+
+public:
+  explicit Runner(std::string_view filter) noexcept : filter(filter) {}
+
+  auto run(std::string_view name, Options options,
+           const std::function<void()> &fn) -> void;
+  auto writeJson(std::ostream &out) const -> void;
+};
+
+// Keeps the optimizer from throwing away the computation of `value`
+template <typename T> inline void do_not_optimize(const T &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+void register_parse(Runner &runner);
+void register_exec(Runner &runner);
+void register_format(Runner &runner);
+void register_selection(Runner &runner);
+void register_backend(Runner &runner);
+void register_analyze(Runner &runner);
+} // namespace bench
@@ -0,0 +1,49 @@
+// Streams a synthetic 200 Hz pen through PenAnalyzer in read()-sized batches,
+// the way `wu --analyze` feeds it.
+#include "analyze.h"
+#include "bench.h"
+#include <vector>
+
+namespace bench {
+
+// `reports` reports of X, Y and a SYN_REPORT each, 5 ms apart give or take
+static std::vector<input_event> synthetic_pen(int reports) {
+  std::vector<input_event> events{};
+  events.reserve(reports * 3 + 1);
+  std::int64_t time = 0;
+  const auto push = [&](int type, int code, int value) {
+    input_event event{};
+    event.input_event_sec = time / 1'000'000;
+    event.input_event_usec = time % 1'000'000;
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    events.push_back(event);
+  };
+  push(EV_KEY, BTN_TOOL_PEN, 1);
+  for (auto i = 0; i < reports; ++i) {
+    time += 5000 + (i * 7919) % 400 - 200;
+    push(EV_ABS, ABS_X, 1000 + i * 3 + i % 5);
+    push(EV_ABS, ABS_Y, 2000 + i % 3);
+    push(EV_SYN, SYN_REPORT, 0);
+  }
+  return events;
+}
+
+void register_analyze(Runner &runner) {
+  for (const auto reports : {1000, 100000}) {
+    const auto events = synthetic_pen(reports);
+    runner.run("analyze_feed/" + std::to_string(reports),
+               {reports > 1000 ? 50uz : 500uz, 1}, [&] {
+                 PenAnalyzer analyzer{};
+                 const std::span<const input_event> all{events};
+                 for (auto i = 0uz; i < all.size();
+                      i += PenAnalyzer::BatchSize) {
+                   analyzer.feed(all.subspan(
+                       i, std::min(PenAnalyzer::BatchSize, all.size() - i)));
+                 }
+                 do_not_optimize(analyzer.summary());
+               });
+  }
+}
+} // namespace bench
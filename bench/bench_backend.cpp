@@ -0,0 +1,72 @@
+// The whole command pipeline, device lookup to apply, against the in-memory
+// mock backend: no tablet, X server or child processes involved.
+#include "backend.h"
+#include "bench.h"
+#include "loop.h"
+#include "wacom.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// Maps every stylus of `backend` and sets its rotation and pressure curve
+static std::vector<WacomCommand> map_all_styluses(MockBackend &backend) {
+  std::vector<WacomCommand> commands{};
+  for (const auto &device : backend.enumerate()) {
+    if (device.type != WacomToolType::Stylus) {
+      continue;
+    }
+    append_commands(
+        commands,
+        WacomConfig{.deviceName = std::string{device.deviceName},
+                    .keepAspect = true,
+                    .rotation = TabletRotation::Half,
+                    .pressureCurve = PressureCurve{0, 10, 90, 100}},
+        Selection{{1920, 1080}, {2560, 360}});
+  }
+  return commands;
+}
+
+void register_backend(Runner &runner) {
+  using std::chrono::microseconds;
+  EventLoop loop{};
+  auto *manager = WacomDeviceManager::getDeviceManager();
+  for (const auto tablets : {1uz, 64uz, 1024uz}) {
+    MockBackend backend{tablets, microseconds{0}};
+    manager->setBackend(backend);
+    const auto commands = map_all_styluses(backend);
+    const auto count = std::to_string(tablets);
+
+    runner.run("mock/list/" + count, {50, 1}, [&] {
+      manager->updateDeviceList();
+      do_not_optimize(manager->getDevices().size());
+    });
+    runner.run("mock/apply/" + count, {50, 1}, [&] {
+      do_not_optimize(perform_commands(loop, backend, commands));
+    });
+    // Every command on its own, awaited one after the other
+    runner.run("mock/perform_each/" + count, {50, 1}, [&] {
+      for (const auto &command : commands) {
+        loop.spawn([](EventLoop &loop, WacomBackend &backend,
+                      const WacomCommand &command) -> Task<void> {
+          do_not_optimize(co_await perform_command(loop, backend, command));
+        }(loop, backend, command));
+      }
+      loop.run();
+    });
+  }
+
+  // With latency, the set-per-command default and a batch that waits once
+  MockBackend slow{64, microseconds{200}};
+  manager->setBackend(slow);
+  const auto commands = map_all_styluses(slow);
+  runner.run("mock/apply_200us/64", {20, 1}, [&] {
+    do_not_optimize(perform_commands(loop, slow, commands));
+  });
+  runner.run("mock/set_concurrent_200us/64", {20, 1}, [&] {
+    do_not_optimize(slow.WacomBackend::apply(loop, commands));
+  });
+  manager->setBackend(XSetWacomBackend::instance());
+}
+} // namespace bench
@@ -0,0 +1,29 @@
+// Spawning a child and collecting its output, against a stub that stands in
+// for xsetwacom.
+#include "bench.h"
+#include "process.h"
+#include <string>
+#include <vector>
+
+namespace bench {
+
+void register_exec(Runner &runner) {
+  const std::string stub = WU_BENCH_STUB;
+  for (const auto bytes : {"0", "512", "65536", "1048576"}) {
+    const std::vector<std::string> args{bytes, "0", "0"};
+    runner.run(std::string{"exec/"} + bytes, {50, 1}, [&] {
+      auto result = ExecResult::exec(stub, args);
+      do_not_optimize(result->std_out().size());
+    });
+    runner.run(std::string{"exec_read/"} + bytes, {50, 1}, [&] {
+      auto [data, err] = read(ExecResult::exec(stub, args));
+      do_not_optimize(data);
+    });
+    ExecResult reused{};
+    runner.run(std::string{"run_reused/"} + bytes, {50, 1}, [&] {
+      ExecResult::run(stub, args, reused);
+      do_not_optimize(reused.std_out().size());
+    });
+  }
+}
+} // namespace bench
@@ -0,0 +1,53 @@
+// String helpers from util.h and format.h
+#include "bench.h"
+#include "format.h"
+#include "util.h"
+#include <array>
+#include <cstdio>
+#include <sstream>
+#include <string>
+
+#if defined(__cpp_lib_format)
+#include <format>
+#endif
+
+namespace bench {
+
+void register_format(Runner &runner) {
+  const std::string path = "/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:"
+                           "/sbin:/bin:/usr/games:/usr/local/games:/snap/bin";
+  runner.run("split_string/PATH", {200, 1024},
+             [&] { do_not_optimize(wu::split_string(path, ':')); });
+
+  int width = 1920, height = 1080, x = 2560, y = 360;
+  runner.run("wu::format/geometry", {200, 1024}, [&] {
+    do_not_optimize(wu::format<48>("{}x{}+{}+{}", width, height, x, y));
+  });
+  runner.run("wu::format_to/geometry", {200, 1024}, [&] {
+    std::array<char, 48> buffer;
+    do_not_optimize(
+        wu::format_to<48>(buffer, "{}x{}+{}+{}", width, height, x, y));
+  });
+
+  // What wu_format used to do: measure with snprintf, then format into a
+  // string sized for it
+  runner.run("snprintf/geometry", {200, 1024}, [&] {
+    const auto length =
+        std::snprintf(nullptr, 0, "%dx%d+%d+%d", width, height, x, y);
+    std::string result(length + 1, '\0');
+    std::snprintf(result.data(), length + 1, "%dx%d+%d+%d", width, height, x,
+                  y);
+    do_not_optimize(result);
+  });
+  runner.run("stringstream/geometry", {200, 1024}, [&] {
+    std::stringstream ss{};
+    ss << width << "x" << height << "+" << x << "+" << y;
+    do_not_optimize(ss.str());
+  });
+#if defined(__cpp_lib_format)
+  runner.run("std::format/geometry", {200, 1024}, [&] {
+    do_not_optimize(std::format("{}x{}+{}+{}", width, height, x, y));
+  });
+#endif
+}
+} // namespace bench
@@ -0,0 +1,108 @@
+// Device list parsing and lookup: the hand written parser and hash index
+// against the std::regex parser and linear scan they replaced.
+#include "backend.h"
+#include "bench.h"
+#include "devices.h"
+#include "wacom.h"
+#include <chrono>
+#include <regex>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+// A device as it was before DeviceList, owning its name and id
+struct RegexDevice {
+  std::string deviceName;
+  std::string id;
+  WacomToolType type;
+};
+
+// The parser as it was before DeviceListParser, kept as the baseline
+static std::vector<RegexDevice> parse_devices_regex(const std::string &input) {
+  static std::regex pattern(R"((.+?)\s+id:\s+(\d+)(?:\s+type:\s+(\w+))?)");
+  std::vector<RegexDevice> result{};
+  auto begin = std::sregex_iterator(input.begin(), input.end(), pattern);
+  auto end = std::sregex_iterator();
+  for (std::sregex_iterator i = begin; i != end; ++i) {
+    std::smatch match = *i;
+    if (match.size() == 4) {
+      result.emplace_back(match[1].str(), match[2].str(),
+                          tool_type_from_string(match[3].str()));
+    }
+  }
+  return result;
+}
+
+static std::string synthetic_device_list(int tablets) {
+  constexpr const char *Tools[][2]{{"Pen stylus", "STYLUS"},
+                                   {"Pen eraser", "ERASER"},
+                                   {"Finger touch", "TOUCH"},
+                                   {"Pad pad", "PAD"}};
+  std::string result{};
+  auto id = 8;
+  for (auto t = 0; t < tablets; ++t) {
+    for (const auto &[tool, type] : Tools) {
+      result += "Wacom Intuos BT M " + std::to_string(t) + " " + tool +
+                "    \tid: " + std::to_string(id++) + "\ttype: " + type +
+                "    \n";
+    }
+  }
+  return result;
+}
+
+void register_parse(Runner &runner) {
+  for (const auto tablets : {1, 64, 4096}) {
+    const auto input = synthetic_device_list(tablets);
+    const auto suffix = "/" + std::to_string(tablets * 4);
+    const auto samples = tablets > 64 ? 20uz : 200uz;
+    const auto batch = tablets > 1 ? 1uz : 64uz;
+
+    runner.run("parse_devices_regex" + suffix, {samples, batch}, [&] {
+      do_not_optimize(parse_devices_regex(input).size());
+    });
+    runner.run("parse_devices" + suffix, {samples, batch},
+               [&] { do_not_optimize(parse_devices(input).size()); });
+    runner.run("DeviceListParser" + suffix, {samples, batch}, [&] {
+      DeviceListParser parser{input};
+      while (const auto entry = parser.next()) {
+        do_not_optimize(entry->id);
+      }
+    });
+
+    const auto devices = parse_devices(input);
+    DeviceIndex index{};
+    index.rebuild(devices);
+    const auto needle = devices[devices.size() - 1].deviceName;
+    runner.run("lookup_linear" + suffix, {200, 64}, [&] {
+      for (const auto &d : devices) {
+        if (d.deviceName == needle || d.id == needle) {
+          do_not_optimize(d);
+          break;
+        }
+      }
+    });
+    runner.run("lookup_index" + suffix, {200, 1024},
+               [&] { do_not_optimize(index.lookup(devices, needle)); });
+  }
+
+  // parse_config goes through the device manager's index. A deferred list
+  // ignores addDevice, so list the (empty) mock backend first rather than
+  // have the first lookup run xsetwacom.
+  auto *manager = WacomDeviceManager::getDeviceManager();
+  MockBackend empty{0, std::chrono::microseconds{0}};
+  manager->setBackend(empty);
+  manager->updateDeviceList();
+  for (const auto &device : parse_devices(synthetic_device_list(64))) {
+    manager->addDevice(device);
+  }
+  const std::string_view quoted[]{"Wacom Intuos BT M 63 Pen stylus"};
+  const std::string_view unquoted[]{"Wacom", "Intuos", "BT",    "M",
+                                    "63",    "Pen",    "stylus"};
+  runner.run("parse_config/quoted", {200, 1024},
+             [&] { do_not_optimize(parse_config(quoted)); });
+  runner.run("parse_config/unquoted", {200, 1024},
+             [&] { do_not_optimize(parse_config(unquoted)); });
+  manager->setBackend(XSetWacomBackend::instance());
+}
+} // namespace bench
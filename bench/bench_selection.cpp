@@ -0,0 +1,43 @@
+// Replays synthetic pointer streams through ActiveSelection, the same way
+// selectScreenArea feeds it.
+#include "bench.h"
+#include "selection.h"
+#include <X11/X.h>
+#include <vector>
+
+namespace bench {
+
+struct PointerEvent {
+  int type;
+  unsigned int button;
+  int x, y;
+};
+
+// A press, `motions` MotionNotify events along a diagonal drag, and a release
+static std::vector<PointerEvent> synthetic_drag(int motions) {
+  std::vector<PointerEvent> events{};
+  events.reserve(motions + 2);
+  events.push_back({ButtonPress, Button1, 100, 100});
+  for (auto i = 0; i < motions; ++i) {
+    events.push_back({MotionNotify, 0, 100 + i % 3840, 100 + i % 2160});
+  }
+  events.push_back({ButtonRelease, Button1, 3000, 1800});
+  return events;
+}
+
+void register_selection(Runner &runner) {
+  for (const auto motions : {100, 10000, 1000000}) {
+    const auto events = synthetic_drag(motions);
+    runner.run("selection_replay/" + std::to_string(motions),
+               {motions > 10000 ? 20uz : 200uz, 1}, [&] {
+                 ActiveSelection selection{};
+                 for (const auto &e : events) {
+                   if (selection.on_event(e.type, e.button, e.x, e.y)) {
+                     break;
+                   }
+                 }
+                 do_not_optimize(selection.selection());
+               });
+  }
+}
+} // namespace bench
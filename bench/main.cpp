@@ -0,0 +1,43 @@
+#include "bench.h"
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+using namespace std::string_view_literals;
+
+static constexpr auto UsageString =
+    R"(wu_bench [--filter SUBSTRING] [--out FILE]
+Runs the benchmarks whose name contains SUBSTRING and writes their
+percentiles as JSON to FILE, or stdout.)";
+
+int main(int argc, const char **argv) {
+  std::string_view filter{};
+  std::string_view outPath{};
+  for (auto i = 1; i < argc; ++i) {
+    const auto arg = std::string_view{argv[i]};
+    if (arg == "--filter"sv && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (arg == "--out"sv && i + 1 < argc) {
+      outPath = argv[++i];
+    } else {
+      std::cerr << UsageString << std::endl;
+      return 1;
+    }
+  }
+
+  bench::Runner runner{filter};
+  bench::register_parse(runner);
+  bench::register_exec(runner);
+  bench::register_format(runner);
+  bench::register_selection(runner);
+  bench::register_backend(runner);
+  bench::register_analyze(runner);
+
+  if (outPath.empty()) {
+    runner.writeJson(std::cout);
+  } else {
+    std::ofstream out{std::string{outPath}};
+    runner.writeJson(out);
+  }
+  return 0;
+}
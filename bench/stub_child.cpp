@@ -0,0 +1,23 @@
+// Stand-in for xsetwacom: writes argv[1] bytes to stdout and argv[2] bytes to
+// stderr, then exits with status argv[3].
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+
+static void write_all(int fd, std::size_t bytes) {
+  const std::string chunk(4096, 'x');
+  while (bytes > 0) {
+    const auto n = std::min(bytes, chunk.size());
+    const auto written = write(fd, chunk.data(), n);
+    if (written <= 0) {
+      return;
+    }
+    bytes -= written;
+  }
+}
+
+int main(int argc, const char **argv) {
+  write_all(STDOUT_FILENO, argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 0);
+  write_all(STDERR_FILENO, argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 0);
+  return argc > 3 ? std::atoi(argv[3]) : 0;
+}
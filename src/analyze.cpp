@@ -0,0 +1,274 @@
+#include "analyze.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Four 64-bit lanes. GCC and Clang lower arithmetic on these to whatever
+// SIMD the target has (and to pairs of SSE2 ops without AVX2), even in an
+// unoptimized build.
+typedef std::int64_t Lanes __attribute__((vector_size(32)));
+static constexpr auto Width = sizeof(Lanes) / sizeof(std::int64_t);
+
+// Lanes only ever pass by reference, so nothing depends on the target
+// having AVX registers to pass them in
+static const Lanes &load(const std::int64_t *from, Lanes &lanes) noexcept {
+  std::memcpy(&lanes, from, sizeof(lanes));
+  return lanes;
+}
+
+static std::int64_t sum(const Lanes &lanes) noexcept {
+  std::int64_t total = 0;
+  for (auto i = 0uz; i < Width; ++i) {
+    total += lanes[i];
+  }
+  return total;
+}
+
+static std::int64_t time_us(const input_event &event) noexcept {
+  return static_cast<std::int64_t>(event.input_event_sec) * 1'000'000 +
+         event.input_event_usec;
+}
+
+// Sum of squares of the second differences of `values` at [from, to)
+static std::uint64_t second_difference_squares(const std::int64_t *values,
+                                               std::size_t from,
+                                               std::size_t to) noexcept {
+  Lanes squares{};
+  auto i = from;
+  for (; i + Width <= to; i += Width) {
+    Lanes at, before, twoBefore;
+    const auto d = load(values + i, at) - 2 * load(values + i - 1, before) +
+                   load(values + i - 2, twoBefore);
+    squares += d * d;
+  }
+  auto total = static_cast<std::uint64_t>(sum(squares));
+  for (; i < to; ++i) {
+    const auto d = values[i] - 2 * values[i - 1] + values[i - 2];
+    total += static_cast<std::uint64_t>(d * d);
+  }
+  return total;
+}
+
+void PenAnalyzer::process() noexcept {
+  if (pending == 0) {
+    return;
+  }
+  const auto end = Carried + pending;
+  // Only intervals and differences that end in a new report; the carried
+  // ones were counted with their own batch
+  const auto intervalsFrom = std::max(Carried - history + 1, Carried);
+  const auto differencesFrom = std::max(Carried - history + 2, Carried);
+  if (intervalsFrom < end) {
+    // Intervals: sum, squares and the longest, four at a time
+    Lanes sums{};
+    Lanes squares{};
+    Lanes longestLanes{};
+    auto i = intervalsFrom;
+    for (; i + Width <= end; i += Width) {
+      Lanes at, before;
+      const auto dt = load(&times[i], at) - load(&times[i - 1], before);
+      sums += dt;
+      squares += dt * dt;
+      longestLanes = dt > longestLanes ? dt : longestLanes;
+    }
+    auto batchSum = sum(sums);
+    auto batchSquares = static_cast<std::uint64_t>(sum(squares));
+    for (auto lane = 0uz; lane < Width; ++lane) {
+      longest = std::max(longest, longestLanes[lane]);
+    }
+    for (; i < end; ++i) {
+      const auto dt = times[i] - times[i - 1];
+      batchSum += dt;
+      batchSquares += static_cast<std::uint64_t>(dt * dt);
+      longest = std::max(longest, dt);
+    }
+    intervalSum += batchSum;
+    intervalSquares += batchSquares;
+    intervalCount += end - intervalsFrom;
+    for (auto j = intervalsFrom; j < end; ++j) {
+      const auto bucket = std::clamp<std::int64_t>(
+          (times[j] - times[j - 1]) / BucketWidthUs, 0, BucketCount - 1);
+      ++buckets[static_cast<std::size_t>(bucket)];
+    }
+  }
+  if (differencesFrom < end) {
+    noiseSquaresX += second_difference_squares(xs.data(), differencesFrom, end);
+    noiseSquaresY += second_difference_squares(ys.data(), differencesFrom, end);
+    noiseCount += end - differencesFrom;
+  }
+  // Keep the last two for the next batch's first intervals and differences
+  for (auto j = 0uz; j < Carried; ++j) {
+    times[j] = times[end - Carried + j];
+    xs[j] = xs[end - Carried + j];
+    ys[j] = ys[end - Carried + j];
+  }
+  history = std::min(history + pending, Carried);
+  pending = 0;
+}
+
+void PenAnalyzer::breakStroke() noexcept {
+  process();
+  history = 0;
+}
+
+void PenAnalyzer::feed(std::span<const input_event> events) noexcept {
+  for (const auto &event : events) {
+    switch (event.type) {
+    case EV_ABS:
+      if (event.code == ABS_X) {
+        x = event.value;
+      } else if (event.code == ABS_Y) {
+        y = event.value;
+      }
+      break;
+    case EV_KEY:
+      if (event.code < BTN_TOOL_PEN || event.code > BTN_TOOL_LENS) {
+        break;
+      }
+      if (event.value == 0 && inProximity) {
+        breakStroke();
+        inProximity = false;
+      } else if (event.value != 0) {
+        inProximity = true;
+      }
+      break;
+    case EV_SYN:
+      if (event.code == SYN_DROPPED) {
+        ++droppedCount;
+        breakStroke();
+      } else if (event.code == SYN_REPORT && inProximity) {
+        const auto at = Carried + pending;
+        times[at] = time_us(event);
+        xs[at] = x;
+        ys[at] = y;
+        ++reportCount;
+        if (++pending == BatchSize) {
+          process();
+        }
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  process();
+}
+
+PenAnalyzer::Summary PenAnalyzer::summary() const noexcept {
+  Summary result{.reports = reportCount,
+                 .intervals = intervalCount,
+                 .rate = 0,
+                 .meanUs = 0,
+                 .jitterUs = 0,
+                 .p50Us = 0,
+                 .p99Us = 0,
+                 .maxUs = longest,
+                 .gaps = 0,
+                 .dropped = droppedCount,
+                 .noiseX = 0,
+                 .noiseY = 0};
+  if (intervalCount > 0) {
+    const auto n = static_cast<double>(intervalCount);
+    result.meanUs = static_cast<double>(intervalSum) / n;
+    result.jitterUs = std::sqrt(std::max(
+        0.0, static_cast<double>(intervalSquares) / n -
+                 result.meanUs * result.meanUs));
+    result.rate = intervalSum > 0 ? n * 1e6 / intervalSum : 0;
+    const auto bucketAt = [this](double quantile) noexcept {
+      const auto rank =
+          static_cast<std::uint64_t>(quantile * (intervalCount - 1));
+      std::uint64_t seen = 0;
+      for (auto i = 0uz; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen > rank) {
+          return i;
+        }
+      }
+      return buckets.size() - 1;
+    };
+    const auto median = bucketAt(0.5);
+    result.p50Us = static_cast<std::int64_t>(median) * BucketWidthUs;
+    result.p99Us = static_cast<std::int64_t>(bucketAt(0.99)) * BucketWidthUs;
+    // From twice the upper end of the median's bucket
+    for (auto i = 2 * (median + 1); i < buckets.size(); ++i) {
+      result.gaps += buckets[i];
+    }
+  }
+  if (noiseCount > 0) {
+    const auto n = static_cast<double>(noiseCount);
+    result.noiseX = std::sqrt(static_cast<double>(noiseSquaresX) / n);
+    result.noiseY = std::sqrt(static_cast<double>(noiseSquaresY) / n);
+  }
+  return result;
+}
+
+int print_analysis(std::ostream &out, const PenAnalyzer &analyzer) noexcept {
+  constexpr auto MaxRows = 16uz;
+  constexpr auto BarWidth = 40.0;
+  const auto summary = analyzer.summary();
+  char line[160];
+  auto lines = 0;
+  const auto emit = [&]() noexcept {
+    out << line << '\n';
+    ++lines;
+  };
+
+  std::snprintf(line, sizeof(line),
+                "reports   %llu (%llu dropped by the kernel)",
+                static_cast<unsigned long long>(summary.reports),
+                static_cast<unsigned long long>(summary.dropped));
+  emit();
+  std::snprintf(line, sizeof(line),
+                "rate      %.1f reports/s, interval %.0f us, jitter %.0f us",
+                summary.rate, summary.meanUs, summary.jitterUs);
+  emit();
+  std::snprintf(
+      line, sizeof(line),
+      "interval  p50 %lld us, p99 %lld us, max %lld us, %llu gaps (%.2f%%)",
+      static_cast<long long>(summary.p50Us),
+      static_cast<long long>(summary.p99Us),
+      static_cast<long long>(summary.maxUs),
+      static_cast<unsigned long long>(summary.gaps),
+      summary.intervals > 0 ? 100.0 * summary.gaps / summary.intervals : 0.0);
+  emit();
+  std::snprintf(line, sizeof(line),
+                "noise     x %.2f, y %.2f (rms second difference, device "
+                "units)",
+                summary.noiseX, summary.noiseY);
+  emit();
+
+  const auto &buckets = analyzer.histogram();
+  const auto used = [](std::uint64_t count) noexcept { return count != 0; };
+  const auto firstUsed = std::ranges::find_if(buckets, used);
+  if (firstUsed == buckets.end()) {
+    out.flush();
+    return lines;
+  }
+  const auto first = static_cast<std::size_t>(firstUsed - buckets.begin());
+  const auto last = buckets.size() - 1 -
+                    static_cast<std::size_t>(
+                        std::ranges::find_if(buckets.rbegin(), buckets.rend(),
+                                             used) -
+                        buckets.rbegin());
+  // Merge neighbouring buckets until the histogram fits
+  const auto merge = (last - first) / MaxRows + 1;
+  std::array<std::uint64_t, MaxRows + 1> rows{};
+  for (auto i = first; i <= last; ++i) {
+    rows[(i - first) / merge] += buckets[i];
+  }
+  const auto rowCount = (last - first) / merge + 1;
+  const auto tallest = *std::max_element(rows.begin(), rows.begin() + rowCount);
+  for (auto row = 0uz; row < rowCount; ++row) {
+    const auto from = (first + row * merge) * PenAnalyzer::BucketWidthUs;
+    const auto open = first + (row + 1) * merge >= buckets.size();
+    const auto bar = static_cast<int>(BarWidth * rows[row] / tallest);
+    std::snprintf(line, sizeof(line), "%6.1f ms%s |%s %llu", from / 1000.0,
+                  open ? "+" : " ", std::string(bar, '#').c_str(),
+                  static_cast<unsigned long long>(rows[row]));
+    emit();
+  }
+  out.flush();
+  return lines;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <linux/input.h>
+#include <ostream>
+#include <span>
+
+// Report rate, jitter and coordinate noise of a tablet tool, computed from
+// its evdev events as they stream in (`wu --analyze`). Nothing is kept per
+// report, so it can run for as long as the pen does.
+//
+// A report is everything up to a SYN_REPORT. Intervals are taken between
+// consecutive reports while the tool is in proximity; leaving proximity or
+// a SYN_DROPPED starts over. Noise is the RMS of the second difference of the
+// position, i.e. how far each report strays from the line through the two
+// before it, in device units.
+class PenAnalyzer {
+public:
+  // Most events feed() looks at in one go; read() that many at a time
+  static constexpr auto BatchSize = 512uz;
+  static constexpr auto BucketWidthUs = 500;
+  // The last bucket holds everything longer
+  static constexpr auto BucketCount = 64uz;
+
+  struct Summary {
+    std::uint64_t reports;
+    std::uint64_t intervals;
+    // reports per second of time in proximity
+    double rate;
+    // mean and standard deviation of the time between reports
+    double meanUs;
+    double jitterUs;
+    // median and 99th percentile, to bucket resolution, and the longest
+    std::int64_t p50Us;
+    std::int64_t p99Us;
+    std::int64_t maxUs;
+    // intervals at least twice the median, i.e. lost or late reports
+    std::uint64_t gaps;
+    std::uint64_t dropped;
+    double noiseX;
+    double noiseY;
+  };
+
+private:
+  // Reports of the current batch, after the two before them (`history` of
+  // which are valid), as arrays of their own so the statistics run several
+  // reports per instruction.
+  static constexpr auto Carried = 2uz;
+  alignas(32) std::array<std::int64_t, Carried + BatchSize> times{};
+  alignas(32) std::array<std::int64_t, Carried + BatchSize> xs{};
+  alignas(32) std::array<std::int64_t, Carried + BatchSize> ys{};
+  std::size_t pending{0};
+  std::size_t history{0};
+
+  // Decoder state
+  std::int64_t x{0};
+  std::int64_t y{0};
+  // Until a tool says otherwise, assume the stream started mid-stroke
+  bool inProximity{true};
+
+  std::uint64_t reportCount{0};
+  std::uint64_t intervalCount{0};
+  std::int64_t intervalSum{0};
+  std::uint64_t intervalSquares{0};
+  std::int64_t longest{0};
+  std::uint64_t noiseCount{0};
+  std::uint64_t noiseSquaresX{0};
+  std::uint64_t noiseSquaresY{0};
+  std::uint64_t droppedCount{0};
+  std::array<std::uint64_t, BucketCount> buckets{};
+
+  // Folds the pending reports into the totals
+  auto process() noexcept -> void;
+  // The next report doesn't follow on from the last one
+  auto breakStroke() noexcept -> void;
+
+public:
+  auto feed(std::span<const input_event> events) noexcept -> void;
+  auto summary() const noexcept -> Summary;
+  auto histogram() const noexcept
+      -> const std::array<std::uint64_t, BucketCount> & {
+    return buckets;
+  }
+};
+
+// Writes the summary and a histogram of the intervals, returns the number of
+// lines written so a live view can draw over them.
+auto print_analysis(std::ostream &out, const PenAnalyzer &analyzer) noexcept
+    -> int;
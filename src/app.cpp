@@ -1,72 +1,269 @@
 #include "app.h"
+#include "control.h"
+#include "eventlog.h"
+#include "overlay.h"
+#include "pacer.h"
+#include "profiles.h"
+#include "rules.h"
 #include "process.h"
 #include "selection.h"
+#include "trace.h"
 #include "util.h"
 #include "wacom.h"
+#include "xinput.h"
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
 #include <charconv>
+#include <chrono>
+#include <csignal>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib> // for getenv
+#include <cstring>
+#include <fcntl.h>
 
 #include <format>
+#include <fstream>
 #include <mutex>
+#include <poll.h>
 #include <string>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 static constexpr auto UsageString =
     R"(wu <"device name" || id>
-Then click and drag the desired area you want to map your device to.)";
+Then click and drag the desired area you want to map your device to.
+
+Options:
+  --keep-aspect   shrink the tablet area to the aspect ratio of the selection
+  --tablet        map every tool (stylus, eraser, touch) of the device's tablet
+  --output NAME   map to the monitor connected to RandR output NAME, e.g. DP-2,
+                  instead of selecting an area
+  --save NAME     also save the mapping as profile NAME
+  --rotate none|cw|ccw|half
+                  also rotate the tablet
+  --pressure-curve X1,Y1,X2,Y2
+                  also set the pressure curve's control points, each 0-100
+  --trace FILE    record how long each step takes and write it to FILE as
+                  Chrome trace JSON (chrome://tracing, ui.perfetto.dev),
+                  with latency percentiles per step
+  --follow-window click a window instead of selecting an area, and keep the
+                  mapping on that window as it moves or resizes
+  --record FILE   also log the pointer events of the selection to FILE, for
+                  --replay
+  --display NAME  work on X display NAME instead of $DISPLAY
+
+wu --replay FILE [--realtime] [options] <"device name" || id>
+Select the area recorded in FILE, without a display or a pen, and map the
+device to it. Events are replayed as fast as possible, or at their recorded
+pace with --realtime. Reports throughput and how long mapping took.
+
+wu --analyze [--record FILE] <"device name" || id>
+wu --analyze --dump FILE
+Read the device's events straight from its evdev node and show its report
+rate, the jitter between reports and coordinate noise, with a histogram of
+report intervals, until Ctrl-C. Reading /dev/input usually takes membership
+of the 'input' group. --record saves the raw stream to FILE, which --dump
+FILE analyzes later without the device (so does a plain
+'cat /dev/input/eventN > FILE').
+
+wu --smooth [FILTER] [--record FILE] <"device name" || id>
+wu --smooth [FILTER] --dump FILE [--record FILE]
+Grab the device's evdev node and re-emit its reports through a virtual
+tablet with position and tilt smoothed, until Ctrl-C. Map the virtual tablet
+like any other device. FILTER is one-euro[:MINCUTOFF[:BETA]] (default
+one-euro:1:0.002) or ema[:MINALPHA[:SPEED]] (default ema:0.3:20000), speeds
+in device units per second. Needs write access to /dev/uinput. With --dump
+it filters a recorded stream instead, into the --record FILE if given, and
+reports how long filtering takes.
+
+wu --apply NAME
+Apply every mapping saved in profile NAME, no interaction needed.
+
+wu --batch [FILE]
+Apply the settings read from FILE (or stdin, also for '-'), one per line:
+  DEVICE area WxH+X+Y [keep-aspect]   map to that screen area
+  DEVICE output NAME [keep-aspect]    map to the monitor on RandR output NAME
+  DEVICE rotate none|cw|ccw|half
+  DEVICE pressure-curve X1,Y1,X2,Y2
+DEVICE is an id or a name, quoted when it has spaces; '#' starts a comment.
+Prints one line per setting: '<line> ok', '<line> failed', '<line> error
+<reason>' for lines that can't be parsed, or '<line> skipped <later line>'
+when a later line sets the same thing on the same device. Lines arriving on
+stdin are read while the ones before them are applied. Exits with 1 if
+anything failed.
+
+wu --profiles
+List saved profiles.
+
+wu --auto [RULES]
+Keep running and apply the profile that RULES (default
+$XDG_CONFIG_HOME/wu/rules) assigns to the focused window's class. Each line
+of RULES is '<window class> <profile>'; a class of '*' matches any window.
+
+wu --server [--display NAME]...
+Keep running and serve every later wu invocation of this user over a Unix
+socket ($XDG_RUNTIME_DIR/wu.sock), which skips connecting to X and looking up
+devices on each of them. Mapping a device given on the command line to an
+--output and --apply are handed to the server; the rest still runs on its
+own. Each invocation is served on its own $DISPLAY (or --display), which the
+server connects to the first time it's asked for, or up front with
+--display.
+
+wu --daemon
+Keep running and serve requests read line by line from stdin:
+  map <"device name" || id>   select an area and map the device to it
+  map-tablet <"device name" || id>
+                              select an area and map all tools of the tablet
+  list                        list known devices
+  refresh                     re-query the device list
+  quit                        exit)";
 
 using namespace std::string_view_literals;
 std::once_flag AppStateInitFlag;
 
 static void print_usage() noexcept { std::cout << UsageString << std::endl; }
 
-bool X11Connection::isOpen() const noexcept { return display != nullptr; }
-void X11Connection::grabPointer() const noexcept {
-  XGrabPointer(display, root, False,
-               ButtonPressMask | ButtonReleaseMask | PointerMotionMask,
-               GrabModeAsync, GrabModeAsync, None, None, CurrentTime);
-}
-
-void X11Connection::ungrabPointer() const noexcept {
-  XUngrabPointer(display, CurrentTime);
-}
-
 ApplicationCliArgs::operator std::span<const std::string_view>()
     const noexcept {
   return std::span<const std::string_view>{cliArgs.data(), cliArgs.size()};
 }
 
 static ApplicationCliArgs createArgs(int argc, const char **argv) noexcept {
+  ApplicationCliArgs result{};
   if (argc == 1) {
-    return ApplicationCliArgs{{}};
+    return result;
   }
 
-  std::vector<std::string_view> args{};
-  args.reserve(argc - 1);
+  result.cliArgs.reserve(argc - 1);
   for (auto i = 1; i < argc; ++i) {
-    args.push_back(std::string_view{argv[i]});
+    const auto arg = std::string_view{argv[i]};
+    const auto hasValue = i + 1 < argc;
+    if (arg == "--daemon"sv) {
+      result.mode = AppMode::Daemon;
+    } else if (arg == "--server"sv) {
+      result.mode = AppMode::Server;
+    } else if (arg == "--display"sv && hasValue) {
+      result.displays.push_back(std::string_view{argv[++i]});
+    } else if (arg == "--trace"sv && hasValue) {
+      result.traceFile = std::string_view{argv[++i]};
+    } else if (arg == "--record"sv && hasValue) {
+      result.recordFile = std::string_view{argv[++i]};
+    } else if (arg == "--replay"sv && hasValue) {
+      result.mode = AppMode::Replay;
+      result.replayFile = std::string_view{argv[++i]};
+    } else if (arg == "--analyze"sv) {
+      result.mode = AppMode::Analyze;
+    } else if (arg == "--smooth"sv) {
+      result.mode = AppMode::Smooth;
+      if (hasValue && filter_from_string(argv[i + 1])) {
+        result.smoothFilter = std::string_view{argv[++i]};
+      }
+    } else if (arg == "--batch"sv) {
+      result.mode = AppMode::Batch;
+      if (hasValue && !std::string_view{argv[i + 1]}.starts_with("--")) {
+        result.batchFile = std::string_view{argv[++i]};
+      }
+    } else if (arg == "--dump"sv && hasValue) {
+      result.dumpFile = std::string_view{argv[++i]};
+    } else if (arg == "--realtime"sv) {
+      result.realtime = true;
+    } else if (arg == "--keep-aspect"sv) {
+      result.keepAspect = true;
+    } else if (arg == "--tablet"sv) {
+      result.wholeTablet = true;
+    } else if (arg == "--output"sv && hasValue) {
+      result.output = std::string_view{argv[++i]};
+    } else if (arg == "--save"sv && hasValue) {
+      result.saveAs = std::string_view{argv[++i]};
+    } else if (arg == "--rotate"sv && hasValue) {
+      result.rotation = rotation_from_string(argv[++i]);
+      if (!result.rotation) {
+        std::cerr << "Invalid rotation '" << argv[i] << "'" << std::endl;
+        print_usage();
+        exit(1);
+      }
+    } else if (arg == "--pressure-curve"sv && hasValue) {
+      result.pressureCurve = pressure_curve_from_string(argv[++i]);
+      if (!result.pressureCurve) {
+        std::cerr << "Invalid pressure curve '" << argv[i] << "'"
+                  << std::endl;
+        print_usage();
+        exit(1);
+      }
+    } else if (arg == "--apply"sv && hasValue) {
+      result.mode = AppMode::ApplyProfile;
+      result.profile = std::string_view{argv[++i]};
+    } else if (arg == "--profiles"sv) {
+      result.mode = AppMode::ListProfiles;
+    } else if (arg == "--follow-window"sv) {
+      result.mode = AppMode::FollowWindow;
+    } else if (arg == "--auto"sv) {
+      result.mode = AppMode::AutoSwitch;
+      if (hasValue && !std::string_view{argv[i + 1]}.starts_with("--")) {
+        result.rulesPath = std::string_view{argv[++i]};
+      }
+    } else {
+      result.cliArgs.push_back(arg);
+    }
   }
-
-  return ApplicationCliArgs{std::move(args)};
+  return result;
 }
 
-ApplicationState::~ApplicationState() noexcept {
-  XCloseDisplay(connection.display);
+ApplicationState::ApplicationState(ApplicationCliArgs &&args,
+                                   std::string display) noexcept
+    : cliArgs(std::move(args)), displayName(std::move(display)), connection() {
+  if (displayName.empty() && !cliArgs.displays.empty()) {
+    displayName = std::string{cliArgs.displays.front()};
+  }
+  if (!displayName.empty()) {
+    xsetwacom = std::make_unique<XSetWacomBackend>(displayName);
+    deviceManager.setBackend(*xsetwacom);
+  }
+  if (auto mock = MockBackend::fromEnvironment(); mock) {
+    mockBackend = std::move(mock);
+    deviceManager.setBackend(*mockBackend);
+  }
 }
 
+ApplicationState::~ApplicationState() noexcept { connection.close(); }
+
 auto ApplicationState::initX11() noexcept -> void {
+  if (!openDisplay()) {
+    exit(1);
+  }
+}
+
+auto ApplicationState::openDisplay() noexcept -> bool {
   if (connection.isOpen()) {
-    return;
+    return true;
   }
+  WU_TRACE_SPAN(trace::Point::DisplayOpen);
   // Open connection to the X server
-  connection.display = XOpenDisplay(NULL);
+  connection.display =
+      XOpenDisplay(displayName.empty() ? nullptr : displayName.c_str());
   if (!connection.isOpen()) {
-    std::cerr << "Unable to open X display" << std::endl;
-    exit(1);
+    std::cerr << "Unable to open X display " << displayName << std::endl;
+    return false;
   }
   connection.screen = DefaultScreen(connection.display);
   connection.root = DefaultRootWindow(connection.display);
+  connection.queryExtensions();
+  monitors.init(connection);
+  if (connection.hasXInput2()) {
+    xi::select_device_events(connection);
+  }
+  loop.watch(ConnectionNumber(connection.display),
+             [this]() { processBackgroundEvents(); });
+  deviceManager.setDeviceSource(&connection);
+  return true;
 }
 
 void ApplicationState::usageError(int exitCode) const {
@@ -103,76 +300,1549 @@ std::optional<WacomDevice> ApplicationState::selectDevice() const noexcept {
   return {};
 }
 
+// What the selection loop does with a pointer event: motion only updates
+// `latestMotion`, which is handed to the selection once per frame; a press or
+// release supersedes it and goes to the selection right away. Returns true
+// once the selection is complete.
+static bool take_pointer_event(ActiveSelection &selection,
+                               std::optional<Vec2> &latestMotion, int type,
+                               unsigned int button, int x, int y) noexcept {
+  if (type == MotionNotify) {
+    latestMotion = Vec2{x, y};
+    return false;
+  }
+  latestMotion.reset();
+  return selection.on_event(type, button, x, y);
+}
+
 Selection ApplicationState::selectScreenArea() noexcept {
   std::cout << "Please click and drag to select an area on the screen."
             << std::endl;
+  std::optional<EventLogWriter> recorder{};
+  if (cliArgs.recordFile) {
+    recorder.emplace(fs::path{cliArgs.recordFile.value()});
+    if (!recorder->isOpen()) {
+      std::cerr << "Can't record to " << cliArgs.recordFile.value() << ": "
+                << strerror(errno) << std::endl;
+      recorder.reset();
+    }
+  }
   connection.grabPointer();
   XEvent event;
   ActiveSelection active_sel{};
-  while (true) {
-    XNextEvent(connection.display, &event);
-    if (event.type == ButtonPress && event.xbutton.button == Button1) {
-      active_sel.on_click(event.xbutton.x_root, event.xbutton.y_root);
-    } else if (event.type == MotionNotify && active_sel.selecting()) {
-      active_sel.on_move(event.xbutton.x_root, event.xbutton.y_root);
-    } else if (event.type == ButtonRelease && event.xbutton.button == Button1) {
-      active_sel.on_release(event.xbutton.x_root, event.xbutton.y_root);
+  SelectionOverlay overlay{connection};
+  // A pen or gaming mouse reports far more often than the screen refreshes.
+  // Only the newest position matters, so keep that and hand it to the
+  // selection (and overlay) once per frame.
+  FramePacer pacer{
+      monitors.frameInterval(connection).value_or(DefaultFrameInterval)};
+  std::optional<Vec2> latestMotion{};
+  std::array<pollfd, 2> fds{
+      pollfd{ConnectionNumber(connection.display), POLLIN, 0},
+      pollfd{pacer.fd(), POLLIN, 0}};
+  [[maybe_unused]] std::uint64_t pressedAt = 0;
+
+  auto finished = false;
+  while (!finished) {
+    // Xlib may already hold queued events that poll can't see, so drain
+    // before waiting.
+    while (!finished && XPending(connection.display) > 0) {
+      XNextEvent(connection.display, &event);
+      if (event.type == MotionNotify) {
+        if (recorder) {
+          recorder->append(MotionNotify, 0, event.xmotion.x_root,
+                           event.xmotion.y_root);
+        }
+        take_pointer_event(active_sel, latestMotion, MotionNotify, 0,
+                           event.xmotion.x_root, event.xmotion.y_root);
+      } else if (event.type == ButtonPress || event.type == ButtonRelease) {
+        if (recorder) {
+          recorder->append(event.type, event.xbutton.button,
+                           event.xbutton.x_root, event.xbutton.y_root);
+        }
+        if (event.type == ButtonPress && !active_sel.selecting()) {
+          WU_TRACE_NOW(pressedAt);
+        }
+        finished = take_pointer_event(
+            active_sel, latestMotion, event.type, event.xbutton.button,
+            event.xbutton.x_root, event.xbutton.y_root);
+        if (!finished && active_sel.selecting()) {
+          overlay.update(
+              monitors.snap(connection, active_sel.current_selection()));
+        }
+      } else {
+        handleEvent(event);
+      }
+    }
+    if (finished) {
       break;
     }
+    if (latestMotion && active_sel.selecting()) {
+      pacer.schedule();
+    } else {
+      latestMotion.reset();
+    }
+
+    if (poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      FATAL("poll failed");
+    }
+    if ((fds[1].revents & POLLIN) && pacer.consume() && latestMotion) {
+      const auto [x, y] = latestMotion.value();
+      active_sel.on_event(MotionNotify, 0, x, y);
+      overlay.update(monitors.snap(connection, active_sel.current_selection()));
+      latestMotion.reset();
+    }
   }
   connection.ungrabPointer();
-  return active_sel.selection();
+  WU_TRACE_RECORD(trace::Point::Selection, pressedAt);
+  return monitors.snap(connection, active_sel.selection());
+}
+
+std::optional<Selection>
+ApplicationState::replaySelection(std::span<const EventRecord> events,
+                                  bool realtime) noexcept {
+  using namespace std::chrono;
+  ActiveSelection active_sel{};
+  std::optional<Vec2> latestMotion{};
+  // Nothing to draw, but realtime keeps handing motion over once per frame
+  FramePacer pacer{DefaultFrameInterval};
+  const auto flushMotion = [&]() noexcept {
+    if (latestMotion && active_sel.selecting()) {
+      const auto [x, y] = latestMotion.value();
+      active_sel.on_event(MotionNotify, 0, x, y);
+    }
+    latestMotion.reset();
+  };
+  const auto start = steady_clock::now();
+  [[maybe_unused]] std::uint64_t pressedAt = 0;
+  for (const auto &record : events) {
+    if (realtime) {
+      const auto due = start + nanoseconds{record.time - events.front().time};
+      for (auto now = steady_clock::now(); now < due;
+           now = steady_clock::now()) {
+        if (latestMotion && active_sel.selecting()) {
+          pacer.schedule();
+        }
+        const auto wait = duration_cast<nanoseconds>(due - now).count();
+        const timespec timeout{.tv_sec = wait / 1'000'000'000,
+                               .tv_nsec = wait % 1'000'000'000};
+        pollfd frame{pacer.fd(), POLLIN, 0};
+        if (ppoll(&frame, 1, &timeout, nullptr) == 1 && pacer.consume()) {
+          flushMotion();
+        }
+      }
+    }
+    if (record.type == ButtonPress && !active_sel.selecting()) {
+      WU_TRACE_NOW(pressedAt);
+    }
+    if (take_pointer_event(active_sel, latestMotion, record.type,
+                           record.button, record.x, record.y)) {
+      WU_TRACE_RECORD(trace::Point::Selection, pressedAt);
+      return monitors.snap(connection, active_sel.selection());
+    }
+    // as fast as possible, every motion is its own frame
+    if (!realtime) {
+      flushMotion();
+    }
+  }
+  return {};
+}
+
+std::optional<Selection> ApplicationState::selectArea() noexcept {
+  if (!cliArgs.output) {
+    return selectScreenArea();
+  }
+  if (const auto monitor = monitors.find(connection, cliArgs.output.value());
+      monitor) {
+    return monitor->geometry;
+  }
+  std::cerr << "No monitor connected to output '" << cliArgs.output.value()
+            << "'. Connected outputs:";
+  for (const auto &monitor : monitors.get(connection)) {
+    std::cerr << " " << monitor.name;
+  }
+  std::cerr << std::endl;
+  return {};
 }
 
 bool ApplicationState::configureWacomMapping(const WacomConfig &cfg,
                                              Selection selection) noexcept {
-  const auto [width, height] = selection.dimensions;
-  const auto [x, y] = selection.origin;
+  std::vector<WacomCommand> commands{};
+  append_commands(commands, cfg, selection);
+  const auto results = perform_commands(
+      loop, WacomDeviceManager::getDeviceManager()->backend(), commands,
+      &connection);
 
-  const auto args =
-      std::vector<std::string>{{"set", cfg.deviceName, "maptooutput",
-                                wu_format("{}x{}+{}+{}", width, height, x, y)}};
-  auto exec = ExecResult::exec("/usr/bin/xsetwacom", args);
-
-  if (exec->succcess()) {
-    std::cout << "Selected area: " << width << "x" << height << "+" << x << "+"
-              << y << std::endl;
+  if (std::ranges::all_of(
+          results, [](CommandResult r) { return r == CommandResult::Ok; })) {
+    std::cout << "Selected area: " << geometry(selection).view() << std::endl;
     return true;
   } else {
-    std::cerr << "Failed to configure mapping to " << width << "x" << height
-              << "+" << x << "+" << y << std::endl;
+    std::cerr << "Failed to configure mapping to "
+              << geometry(selection).view() << std::endl;
+    return false;
+  }
+}
+
+// The configuration for `tool` when mapping its whole tablet like `cfg`.
+// Rotation is shared by all tools of a tablet, so only `first` carries it;
+// only pens have a pressure curve.
+static WacomConfig tool_config(const WacomConfig &cfg, const WacomDevice &tool,
+                               bool first) noexcept {
+  const auto pen = tool.type == WacomToolType::Stylus ||
+                   tool.type == WacomToolType::Eraser;
+  return WacomConfig{
+      .deviceName = std::string{tool.id},
+      .keepAspect = cfg.keepAspect,
+      .rotation = first ? cfg.rotation : std::nullopt,
+      .pressureCurve = pen ? cfg.pressureCurve : std::nullopt};
+}
+
+bool ApplicationState::configureTabletMapping(const WacomConfig &cfg,
+                                              Selection selection) noexcept {
+  const auto tools =
+      WacomDeviceManager::getDeviceManager()->getTablet(cfg.deviceName);
+  std::vector<WacomCommand> commands{};
+  // index into `mapped` of the tool each command configures
+  std::vector<std::size_t> owners{};
+  // name and type, which have to outlive hotplug while the commands run
+  std::vector<std::pair<std::string, WacomToolType>> mapped{};
+  for (const auto &tool : tools) {
+    // The pad has buttons and rings, no absolute axes to map
+    if (tool.type == WacomToolType::Pad) {
+      continue;
+    }
+    append_commands(commands, tool_config(cfg, tool, mapped.empty()),
+                    selection);
+    owners.resize(commands.size(), mapped.size());
+    mapped.emplace_back(tool.deviceName, tool.type);
+  }
+  if (commands.empty()) {
+    std::cerr << "No tools found for tablet of '" << cfg.deviceName << "'"
+              << std::endl;
+    return false;
+  }
+
+  const auto results = perform_commands(
+      loop, WacomDeviceManager::getDeviceManager()->backend(), commands,
+      &connection);
+  std::vector<bool> success(mapped.size(), true);
+  for (auto i = 0uz; i < results.size(); ++i) {
+    if (results[i] != CommandResult::Ok) {
+      success[owners[i]] = false;
+    }
+  }
+  auto ok = true;
+  for (auto i = 0uz; i < mapped.size(); ++i) {
+    const auto &[name, type] = mapped[i];
+    std::cout << (success[i] ? "  mapped " : "  failed ") << to_string(type)
+              << ": " << name << std::endl;
+    ok = ok && success[i];
+  }
+  std::cout << "Selected area: " << geometry(selection).view() << std::endl;
+  return ok;
+}
+
+bool ApplicationState::configure(const WacomConfig &cfg,
+                                 Selection selection) noexcept {
+  return cliArgs.wholeTablet ? configureTabletMapping(cfg, selection)
+                             : configureWacomMapping(cfg, selection);
+}
+
+bool ApplicationState::saveProfile(std::string_view name,
+                                   const WacomConfig &cfg,
+                                   Selection selection) const noexcept {
+  std::uint32_t flags = 0;
+  if (cfg.keepAspect) {
+    flags |= ProfileFlags::KeepAspect;
+  }
+  if (cliArgs.wholeTablet) {
+    flags |= ProfileFlags::WholeTablet;
+  }
+  // ids are handed out by the X server and change between sessions, names
+  // don't
+  const auto *device =
+      WacomDeviceManager::getDeviceManager()->findDevice(cfg.deviceName);
+  auto record = ProfileRecord::make(
+      name, device ? device->deviceName : cfg.deviceName, selection, flags);
+  if (!record) {
+    std::cerr << "Profile or device name too long" << std::endl;
+    return false;
+  }
+  if (cfg.rotation) {
+    record->flags |= ProfileFlags::HasRotation;
+    record->rotation = static_cast<std::int32_t>(cfg.rotation.value());
+  }
+  if (cfg.pressureCurve) {
+    record->flags |= ProfileFlags::HasPressureCurve;
+    std::ranges::copy(cfg.pressureCurve.value(), record->pressureCurve);
+  }
+  const ProfileStore store{ProfileStore::defaultPath()};
+  if (!store.save(record.value())) {
     return false;
   }
+  std::cout << "Saved profile '" << name << "'" << std::endl;
+  return true;
+}
+
+bool ApplicationState::applyProfile(std::string_view name) noexcept {
+  const ProfileStore store{ProfileStore::defaultPath()};
+  return applyProfile(store, name);
+}
+
+bool ApplicationState::applyProfile(const ProfileStore &store,
+                                    std::string_view name) noexcept {
+  const auto records = store.find(name);
+  if (records.empty()) {
+    std::cerr << "No profile named '" << name << "'" << std::endl;
+    return false;
+  }
+  // Writing properties ourselves beats spawning xsetwacom per setting
+  initX11();
+
+  auto *manager = WacomDeviceManager::getDeviceManager();
+  std::vector<WacomCommand> commands{};
+  for (const auto &record : records) {
+    auto cfg = WacomConfig{
+        .deviceName = std::string{record.deviceName()},
+        .keepAspect = (record.flags & ProfileFlags::KeepAspect) != 0};
+    if (record.flags & ProfileFlags::HasRotation) {
+      cfg.rotation = static_cast<TabletRotation>(record.rotation);
+    }
+    if (record.flags & ProfileFlags::HasPressureCurve) {
+      cfg.pressureCurve.emplace();
+      std::ranges::copy(record.pressureCurve, cfg.pressureCurve->begin());
+    }
+    if ((record.flags & ProfileFlags::WholeTablet) == 0) {
+      append_commands(commands, cfg, record.selection());
+      continue;
+    }
+    auto first = true;
+    for (const auto &tool : manager->getTablet(cfg.deviceName)) {
+      if (tool.type != WacomToolType::Pad) {
+        append_commands(commands, tool_config(cfg, tool, first),
+                        record.selection());
+        first = false;
+      }
+    }
+  }
+
+  const auto results = perform_commands(
+      loop, WacomDeviceManager::getDeviceManager()->backend(), commands,
+      &connection);
+  const auto failed = std::ranges::count_if(
+      results, [](CommandResult r) { return r != CommandResult::Ok; });
+  if (failed > 0) {
+    std::cerr << "Profile '" << name << "': " << failed << " of "
+              << results.size() << " settings failed" << std::endl;
+  }
+  return failed == 0 && !results.empty();
+}
+
+void ApplicationState::listProfiles() const noexcept {
+  const ProfileStore store{ProfileStore::defaultPath()};
+  for (const auto &record : store.all()) {
+    std::cout << record.profileName() << "\t" << record.deviceName() << "\t"
+              << geometry(record.selection()).view() << std::endl;
+  }
+}
+
+static std::string_view trim(std::string_view str) noexcept {
+  constexpr auto Whitespace = " \t\r\n"sv;
+  const auto begin = str.find_first_not_of(Whitespace);
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  const auto end = str.find_last_not_of(Whitespace);
+  return str.substr(begin, end - begin + 1);
 }
 
-/*static*/
-std::expected<fs::path, const char *>
-ApplicationState::verifyHasXSetWacom() noexcept {
-  const auto pathEnv = std::getenv("PATH");
-  if (pathEnv == nullptr) {
-    std::cerr << "PATH environment variable not found." << std::endl;
-    return std::unexpected{"Could not determine if $PATH environment variable "
-                           "existed. Can't resolve xsetwacom because of it."};
+bool ApplicationState::handleDaemonRequest(std::string_view line) noexcept {
+  auto manager = WacomDeviceManager::getDeviceManager();
+  auto request = trim(line);
+  const auto split = request.find_first_of(" \t");
+  const auto command = request.substr(0, split);
+  auto argument = split == std::string_view::npos
+                      ? std::string_view{}
+                      : trim(request.substr(split + 1));
+  if (argument.size() >= 2 && argument.front() == '"' &&
+      argument.back() == '"') {
+    argument = argument.substr(1, argument.size() - 2);
   }
 
-  const auto paths = wu::split_string(pathEnv, ':');
+  if (command.empty()) {
+    return true;
+  } else if (command == "quit"sv) {
+    return false;
+  } else if (command == "refresh"sv) {
+    manager->updateDeviceList(&connection);
+    std::cout << "ok " << manager->getDevices().size() << std::endl;
+  } else if (command == "list"sv) {
+    for (const auto &device : manager->getDevices()) {
+      std::cout << device.id << "\t" << device.deviceName << "\n";
+    }
+    std::cout << "ok" << std::endl;
+  } else if (command == "map"sv || command == "map-tablet"sv) {
+    if (argument.empty() || !manager->hasDevice(argument)) {
+      std::cout << "error unknown device '" << argument << "'" << std::endl;
+      return true;
+    }
+    const auto select = selectArea();
+    if (!select) {
+      std::cout << "error no such output" << std::endl;
+      return true;
+    }
+    const auto cfg = WacomConfig{.deviceName = std::string{argument},
+                                 .keepAspect = cliArgs.keepAspect,
+                                 .rotation = cliArgs.rotation,
+                                 .pressureCurve = cliArgs.pressureCurve};
+    const auto ok = command == "map"sv
+                        ? configureWacomMapping(cfg, select.value())
+                        : configureTabletMapping(cfg, select.value());
+    std::cout << (ok ? "ok" : "error mapping failed") << std::endl;
+  } else {
+    std::cout << "error unknown command '" << command << "'" << std::endl;
+  }
+  return true;
+}
 
-  fs::path path = "/";
-  for (const auto &p : paths) {
-    path = fs::path{p} / "xsetwacom";
-    if (fs::exists(path)) {
-      return path;
+int ApplicationState::runDaemon() noexcept {
+  // Resident: pay for the device list once, up front
+  WacomDeviceManager::getDeviceManager()->updateDeviceList(&connection);
+  std::cout << "wu daemon ready" << std::endl;
+  // Wait on both stdin and the X connection, so hotplug events patch the
+  // device list while we're idle.
+  std::array<pollfd, 2> fds{pollfd{STDIN_FILENO, POLLIN, 0},
+                            pollfd{ConnectionNumber(connection.display),
+                                   POLLIN, 0}};
+  std::string pending{};
+  char buf[512];
+  for (;;) {
+    processPendingEvents();
+    if (poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      FATAL("poll failed");
     }
+    if (fds[0].revents == 0) {
+      continue;
+    }
+    const auto bytes = ::read(STDIN_FILENO, buf, sizeof(buf));
+    if (bytes <= 0) {
+      break;
+    }
+    pending.append(buf, bytes);
+    for (auto newline = pending.find('\n'); newline != std::string::npos;
+         newline = pending.find('\n')) {
+      const auto keepRunning =
+          handleDaemonRequest(std::string_view{pending}.substr(0, newline));
+      pending.erase(0, newline + 1);
+      if (!keepRunning) {
+        return 0;
+      }
+    }
+  }
+  // EOF without a trailing newline
+  handleDaemonRequest(pending);
+  return 0;
+}
+
+// The request a client sends right after connecting, or nothing if it
+// doesn't within a moment, so one that never does can't stall everyone else
+static std::vector<char> receive_request(int client) noexcept {
+  constexpr auto RequestTimeoutMs = 100;
+  std::vector<char> request(control::MaxRequestSize);
+  pollfd readable{client, POLLIN, 0};
+  ssize_t size = -1;
+  if (poll(&readable, 1, RequestTimeoutMs) == 1) {
+    size = recv(client, request.data(), request.size(), MSG_DONTWAIT);
+  }
+  request.resize(size > 0 ? static_cast<std::size_t>(size) : 0);
+  return request;
+}
+
+static void reply(int client, int exitCode) noexcept {
+  const control::Response response{.exitCode = exitCode};
+  send(client, &response, sizeof(response), MSG_NOSIGNAL);
+  close(client);
+}
+
+// ":0" and ":0.0" are the same display
+static std::string_view display_key(std::string_view name) noexcept {
+  if (name.ends_with(".0"sv) && name.find(':') != std::string_view::npos) {
+    name.remove_suffix(2);
+  }
+  return name;
+}
+
+void ApplicationState::serveControlRequest(
+    int client, std::span<const char> request) noexcept {
+  const WacomDeviceManager::Scope scope{deviceManager};
+  auto args = control::decode_request(request);
+  auto exitCode = 1;
+  // Only take what's safe to do without a terminal: the device must resolve
+  // without asking which one was meant.
+  if (args && control::is_forwardable(args.value()) &&
+      (args->mode != AppMode::Map || parse_config(args.value()))) {
+    std::swap(cliArgs, args.value());
+    exitCode = run();
+    std::swap(cliArgs, args.value());
+  }
+  reply(client, exitCode);
+  // Xlib may have queued events while the request ran
+  processPendingEvents();
+}
+
+// A display the server serves, and the strand everything touching it runs on
+struct ServedDisplay {
+  std::string key;
+  // null until the display is open, and again once it's been lost
+  ApplicationState *app{nullptr};
+  // null for the display the server was started on
+  std::unique_ptr<ApplicationState> owned{};
+  // set by Xlib, on the strand, when the connection breaks
+  bool lost{false};
+  Strand strand;
+
+  ServedDisplay(std::string_view name, ThreadPool &pool) noexcept
+      : key(display_key(name)), strand(pool) {}
+};
+
+// Xlib's default would exit(); losing one display must not end the others
+static int report_lost_display(Display *display) noexcept {
+  std::cerr << "Lost X display " << DisplayString(display) << std::endl;
+  return 0;
+}
+
+int ApplicationState::runServer() noexcept {
+  control::Server server{control::socket_path()};
+  if (!server.listen()) {
+    return 1;
+  }
+  // Take termination through a signalfd, so the socket gets unlinked on the
+  // way out.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGHUP);
+  sigprocmask(SIG_BLOCK, &signals, nullptr);
+  const auto signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  const auto epollFd = epoll_create1(EPOLL_CLOEXEC);
+  if (signalFd == -1 || epollFd == -1) {
+    FATAL("signalfd or epoll_create1 failed");
+  }
+  // Tags for the two fds that aren't a display's; displays go by address
+  constexpr std::uint64_t ServerTag = 0;
+  constexpr std::uint64_t SignalTag = 1;
+  for (const auto &[fd, tag] :
+       {std::pair{server.fd(), ServerTag}, std::pair{signalFd, SignalTag}}) {
+    epoll_event event{.events = EPOLLIN, .data = {.u64 = tag}};
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+  }
+  XSetIOErrorHandler(report_lost_display);
+
+  // A worker spends a whole interactive selection on its display, so have a
+  // few of them
+  ThreadPool pool{std::clamp(std::thread::hardware_concurrency(), 2u, 8u)};
+  // Looked up from the pool, where requests are received
+  std::mutex displaysLock{};
+  std::vector<std::unique_ptr<ServedDisplay>> displays{};
+  ServedDisplay *primary = nullptr;
+  // Lost displays, kept until the pool stops since jobs already posted to
+  // their strands still refer to them
+  std::vector<std::unique_ptr<ServedDisplay>> retired{};
+
+  // Stops serving `display`. Closing the connection takes its fd out of
+  // epoll; a later request for it opens it afresh.
+  const auto retire = [&](ServedDisplay &display) noexcept {
+    if (display.owned) {
+      display.owned.reset();
+    } else if (display.app != nullptr) {
+      display.app->connection.close();
+    }
+    display.app = nullptr;
+    std::lock_guard lock{displaysLock};
+    if (primary == &display) {
+      primary = nullptr;
+    }
+    const auto it = std::ranges::find_if(
+        displays, [&](const auto &served) { return served.get() == &display; });
+    if (it != displays.end()) {
+      retired.push_back(std::move(*it));
+      displays.erase(it);
+    }
+  };
+  // After a job on `display`: re-arm its X fd, one-shot so a busy display
+  // isn't reported over and over, or retire it if the job lost it
+  const auto settle = [&](ServedDisplay &display, int op) noexcept {
+    if (display.lost) {
+      std::cerr << "No longer serving display " << display.key << std::endl;
+      retire(display);
+      return;
+    }
+    epoll_event event{.events = EPOLLIN | EPOLLONESHOT,
+                      .data = {.u64 = reinterpret_cast<std::uintptr_t>(
+                                   &display)}};
+    epoll_ctl(epollFd, op, ConnectionNumber(display.app->connection.display),
+              &event);
+  };
+  // Runs on the display's strand once it's open
+  const auto start = [&](ServedDisplay &display) noexcept {
+    auto &app = *display.app;
+    XSetIOErrorExitHandler(
+        app.connection.display,
+        [](Display *, void *served) noexcept {
+          static_cast<ServedDisplay *>(served)->lost = true;
+        },
+        &display);
+    const WacomDeviceManager::Scope scope{app.deviceManager};
+    app.deviceManager.setResident(true);
+    app.deviceManager.updateDeviceList(&app.connection);
+    app.processPendingEvents();
+    std::cout << "Serving display " << display.key << std::endl;
+    settle(display, EPOLL_CTL_ADD);
+  };
+  // The display named `name`; one we aren't serving yet is opened on its
+  // strand, so a slow or unreachable X server holds up only the requests
+  // for it
+  const auto find = [&](std::string_view name) noexcept -> ServedDisplay * {
+    std::lock_guard lock{displaysLock};
+    if (name.empty()) {
+      return primary;
+    }
+    for (auto &display : displays) {
+      if (display->key == display_key(name)) {
+        return display.get();
+      }
+    }
+    auto &display =
+        *displays.emplace_back(std::make_unique<ServedDisplay>(name, pool));
+    display.strand.post([&display, &start, &retire]() {
+      auto app = std::make_unique<ApplicationState>(ApplicationCliArgs{},
+                                                    display.key);
+      if (!app->openDisplay()) {
+        retire(display);
+        return;
+      }
+      display.owned = std::move(app);
+      display.app = display.owned.get();
+      start(display);
+    });
+    return &display;
+  };
+
+  primary = displays
+                .emplace_back(std::make_unique<ServedDisplay>(
+                    DisplayString(connection.display), pool))
+                .get();
+  primary->app = this;
+  primary->strand.post([&start, primary]() { start(*primary); });
+  for (const auto name : cliArgs.displays) {
+    find(name);
+  }
+
+  std::cout << "wu server listening on " << control::socket_path().native()
+            << std::endl;
+  std::array<epoll_event, 16> events{};
+  auto running = true;
+  while (running) {
+    const auto count = epoll_wait(epollFd, events.data(), events.size(), -1);
+    if (count == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      FATAL("epoll_wait failed");
+    }
+    for (auto i = 0; i < count; ++i) {
+      const auto tag = events[i].data.u64;
+      if (tag == SignalTag) {
+        running = false;
+      } else if (tag == ServerTag) {
+        // Waiting for what a client sends happens on the pool, so a slow
+        // client holds up nobody else
+        for (auto client = server.accept(); client != -1;
+             client = server.accept()) {
+          pool.post([client, &find, &settle]() {
+            auto request = receive_request(client);
+            const auto args = control::decode_request(request);
+            auto *display =
+                args ? find(args->displays.empty() ? std::string_view{}
+                                                   : args->displays.front())
+                     : nullptr;
+            if (display == nullptr) {
+              reply(client, 1);
+              return;
+            }
+            display->strand.post([display, client, &settle,
+                                  request = std::move(request)]() {
+              if (display->app == nullptr) {
+                reply(client, 1);
+                return;
+              }
+              display->app->serveControlRequest(client, request);
+              // epoll still has the fd armed
+              if (display->lost) {
+                settle(*display, EPOLL_CTL_MOD);
+              }
+            });
+          });
+        }
+      } else {
+        auto &display = *reinterpret_cast<ServedDisplay *>(tag);
+        display.strand.post([&display, &settle]() {
+          if (display.app == nullptr) {
+            return;
+          }
+          const WacomDeviceManager::Scope scope{display.app->deviceManager};
+          display.app->processPendingEvents();
+          settle(display, EPOLL_CTL_MOD);
+        });
+      }
+    }
+  }
+  // Finish what's been posted while every display is still there
+  pool.join();
+  close(signalFd);
+  close(epollFd);
+  return 0;
+}
+
+// The window _NET_ACTIVE_WINDOW on the root window points at, if any
+static Window active_window(const X11Connection &x11, Atom property) noexcept {
+  Atom type;
+  int format;
+  unsigned long items;
+  unsigned long remaining;
+  unsigned char *data = nullptr;
+  Window result = None;
+  const XErrorTrap trap{};
+  if (XGetWindowProperty(x11.display, x11.root, property, 0, 1, False,
+                         XA_WINDOW, &type, &format, &items, &remaining,
+                         &data) == Success &&
+      type == XA_WINDOW && format == 32 && items == 1) {
+    result = *reinterpret_cast<Window *>(data);
+  }
+  if (data != nullptr) {
+    XFree(data);
+  }
+  return trap.failed(x11.display) ? None : result;
+}
+
+// WM_CLASS of `window`, instance and class name. Nothing if the window is
+// gone, which focus churn makes common: closing dialogs, alt-tab through
+// windows that are closing.
+static std::optional<std::pair<std::string, std::string>>
+window_class(const X11Connection &x11, Window window) noexcept {
+  XClassHint hint{};
+  const XErrorTrap trap{};
+  const auto found = XGetClassHint(x11.display, window, &hint) != 0;
+  const auto gone = trap.failed(x11.display);
+  std::optional<std::pair<std::string, std::string>> result{};
+  if (found && !gone) {
+    result.emplace(hint.res_name ? hint.res_name : "",
+                   hint.res_class ? hint.res_class : "");
+  }
+  XFree(hint.res_name);
+  XFree(hint.res_class);
+  return result;
+}
+
+int ApplicationState::runAutoSwitch() noexcept {
+  const auto rulesPath = cliArgs.rulesPath
+                             ? fs::path{cliArgs.rulesPath.value()}
+                             : RuleTable::defaultPath();
+  RuleTable rules{};
+  if (!rules.load(rulesPath)) {
+    std::cerr << "Could not read rules from " << rulesPath << std::endl;
+    return 1;
+  }
+  // One store for the whole run, the file stays mapped
+  const ProfileStore store{ProfileStore::defaultPath()};
+
+  const auto netActiveWindow =
+      XInternAtom(connection.display, "_NET_ACTIVE_WINDOW", False);
+  XSelectInput(connection.display, connection.root, PropertyChangeMask);
+
+  // Focus tends to bounce through several windows (alt-tab, closing dialogs)
+  // before it settles. Wait for a short quiet period before applying, which
+  // is still well under a frame.
+  constexpr auto Debounce = std::chrono::milliseconds{4};
+  FramePacer debounce{Debounce};
+  std::string active{};
+  std::string pending{};
+  std::array<pollfd, 2> fds{
+      pollfd{ConnectionNumber(connection.display), POLLIN, 0},
+      pollfd{debounce.fd(), POLLIN, 0}};
+
+  const auto onFocusChange = [&]() {
+    const auto window = active_window(connection, netActiveWindow);
+    const auto windowClass =
+        window == None ? std::nullopt : window_class(connection, window);
+    if (!windowClass) {
+      return;
+    }
+    const auto profile = rules.lookup(windowClass->first, windowClass->second);
+    if (!profile) {
+      // no rule for it, whatever is mapped stays mapped
+      return;
+    }
+    if (profile.value() == active) {
+      // same rule as the window we came from, nothing to do
+      pending.clear();
+      debounce.cancel();
+      return;
+    }
+    pending = profile.value();
+    debounce.restart(Debounce);
+  };
+
+  std::cout << "Switching mappings for " << rules.size() << " rules"
+            << std::endl;
+  onFocusChange();
+  XEvent event;
+  for (;;) {
+    while (XPending(connection.display) > 0) {
+      XNextEvent(connection.display, &event);
+      if (event.type == PropertyNotify &&
+          event.xproperty.atom == netActiveWindow) {
+        onFocusChange();
+      } else {
+        handleEvent(event);
+      }
+    }
+    if (poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      FATAL("poll failed");
+    }
+    if ((fds[1].revents & POLLIN) && debounce.consume() && !pending.empty()) {
+      if (applyProfile(store, pending)) {
+        std::cout << "Applied profile '" << pending << "'" << std::endl;
+      }
+      // don't retry a broken profile on every focus change
+      active = std::move(pending);
+      pending.clear();
+    }
+  }
+  return 0;
+}
+
+// Whether `window` has WM_STATE, i.e. is a client window managed by the WM
+static bool has_wm_state(const X11Connection &x11, Window window,
+                         Atom wmState) noexcept {
+  Atom type = None;
+  int format;
+  unsigned long items;
+  unsigned long remaining;
+  unsigned char *data = nullptr;
+  XGetWindowProperty(x11.display, window, wmState, 0, 0, False,
+                     AnyPropertyType, &type, &format, &items, &remaining,
+                     &data);
+  if (data != nullptr) {
+    XFree(data);
+  }
+  return type != None;
+}
+
+// The client window inside the window manager frame `frame`
+static Window client_window(const X11Connection &x11, Window frame,
+                            Atom wmState, int depth = 0) noexcept {
+  if (has_wm_state(x11, frame, wmState)) {
+    return frame;
+  }
+  Window root;
+  Window parent;
+  Window *children = nullptr;
+  unsigned int count = 0;
+  Window result = None;
+  if (depth < 4 && XQueryTree(x11.display, frame, &root, &parent, &children,
+                              &count)) {
+    for (auto i = 0u; i < count && result == None; ++i) {
+      result = client_window(x11, children[i], wmState, depth + 1);
+    }
+  }
+  if (children != nullptr) {
+    XFree(children);
+  }
+  return result;
+}
+
+Window ApplicationState::selectWindow() noexcept {
+  std::cout << "Click the window to map to." << std::endl;
+  connection.grabPointer();
+  XEvent event;
+  Window frame = None;
+  while (frame == None) {
+    XNextEvent(connection.display, &event);
+    if (event.type == ButtonPress && event.xbutton.button == Button1) {
+      // the top level window under the pointer, which is usually the WM's
+      // frame around the client
+      frame = event.xbutton.subwindow != None ? event.xbutton.subwindow
+                                              : connection.root;
+    } else if (event.type != ButtonRelease && event.type != MotionNotify) {
+      handleEvent(event);
+    }
+  }
+  connection.ungrabPointer();
+  if (frame == connection.root) {
+    return frame;
+  }
+  const auto wmState = XInternAtom(connection.display, "WM_STATE", False);
+  const XErrorTrap trap{};
+  const auto client = client_window(connection, frame, wmState);
+  if (trap.failed(connection.display)) {
+    // closed before we got to look inside it
+    return None;
+  }
+  return client != None ? client : frame;
+}
+
+// Geometry of `window` in root window coordinates, nothing if it's gone
+static std::optional<Selection> window_geometry(const X11Connection &x11,
+                                                Window window) noexcept {
+  // The window may be destroyed with its DestroyNotify still queued
+  const XErrorTrap trap{};
+  XWindowAttributes attributes;
+  int x;
+  int y;
+  Window child;
+  if (!XGetWindowAttributes(x11.display, window, &attributes) ||
+      !XTranslateCoordinates(x11.display, window, x11.root, 0, 0, &x, &y,
+                             &child) ||
+      trap.failed(x11.display)) {
+    return {};
+  }
+  return Selection{.dimensions = {attributes.width, attributes.height},
+                   .origin = {x, y}};
+}
+
+int ApplicationState::runFollowWindow(const WacomConfig &cfg) noexcept {
+  const auto window = selectWindow();
+  if (window == connection.root) {
+    std::cerr << "No window selected" << std::endl;
+    return 1;
+  }
+  const auto closed = []() noexcept {
+    std::cout << "Window closed" << std::endl;
+    return 0;
+  };
+  if (window == None) {
+    return closed();
+  }
+
+  // A reparented client isn't told when its frame moves, so listen to every
+  // ancestor below the root as well.
+  std::vector<Window> watched{window};
+  {
+    const XErrorTrap trap{};
+    for (auto w = window;;) {
+      Window root;
+      Window parent;
+      Window *children = nullptr;
+      unsigned int count = 0;
+      if (!XQueryTree(connection.display, w, &root, &parent, &children,
+                      &count)) {
+        break;
+      }
+      if (children != nullptr) {
+        XFree(children);
+      }
+      if (parent == root || parent == None) {
+        break;
+      }
+      watched.push_back(parent);
+      w = parent;
+    }
+    for (const auto w : watched) {
+      XSelectInput(connection.display, w, StructureNotifyMask);
+    }
+    if (trap.failed(connection.display)) {
+      return closed();
+    }
+  }
+
+  // A window drag produces a ConfigureNotify per pointer motion; remap at
+  // most this often, with the latest geometry.
+  constexpr auto FollowInterval = std::chrono::milliseconds{50};
+  FramePacer limiter{FollowInterval};
+  std::optional<Selection> applied{};
+  auto dirty = true;
+  std::array<pollfd, 2> fds{
+      pollfd{ConnectionNumber(connection.display), POLLIN, 0},
+      pollfd{limiter.fd(), POLLIN, 0}};
+
+  XEvent event;
+  for (;;) {
+    while (XPending(connection.display) > 0) {
+      XNextEvent(connection.display, &event);
+      if (event.type == ConfigureNotify) {
+        dirty = true;
+      } else if (event.type == DestroyNotify &&
+                 event.xdestroywindow.window == window) {
+        return closed();
+      } else {
+        handleEvent(event);
+      }
+    }
+    if (dirty) {
+      limiter.schedule();
+    }
+    if (poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      FATAL("poll failed");
+    }
+    if ((fds[1].revents & POLLIN) && limiter.consume() && dirty) {
+      dirty = false;
+      const auto geometry = window_geometry(connection, window);
+      if (!geometry) {
+        return closed();
+      }
+      if (applied != geometry) {
+        configure(cfg, geometry.value());
+        applied = geometry;
+      }
+    }
+  }
+  return 0;
+}
+
+void ApplicationState::handleEvent(XEvent &event) noexcept {
+  if (monitors.handleEvent(event)) {
+    return;
+  }
+  if (connection.hasXInput2()) {
+    xi::handle_device_event(connection, event,
+                            *WacomDeviceManager::getDeviceManager());
+  }
+}
+
+void ApplicationState::processPendingEvents() noexcept {
+  XEvent event;
+  while (XPending(connection.display) > 0) {
+    XNextEvent(connection.display, &event);
+    handleEvent(event);
+  }
+}
+
+int ApplicationState::runReplay() noexcept {
+  using namespace std::chrono;
+  const EventLog log{fs::path{cliArgs.replayFile}};
+  if (!log.isOpen()) {
+    std::cerr << "Can't read event log " << cliArgs.replayFile << std::endl;
+    return 1;
+  }
+  auto config = parse_config(cliArgs);
+  if (!config) {
+    std::cerr << "--replay needs the device to map" << std::endl;
+    return 1;
+  }
+  config->keepAspect = cliArgs.keepAspect;
+  config->rotation = cliArgs.rotation;
+  config->pressureCurve = cliArgs.pressureCurve;
+
+  const auto events = log.records();
+  const auto started = steady_clock::now();
+  const auto selection = replaySelection(events, cliArgs.realtime);
+  const auto selected = steady_clock::now();
+  if (!selection) {
+    std::cerr << "No complete selection in " << cliArgs.replayFile
+              << std::endl;
+    return 1;
+  }
+  const auto ok = configure(config.value(), selection.value());
+  const auto applied = steady_clock::now();
+
+  const auto replayed = duration<double>(selected - started).count();
+  std::cout << "Replayed " << events.size() << " events in "
+            << replayed * 1e3 << " ms ("
+            << (replayed > 0 ? events.size() / replayed : 0.0)
+            << " events/s), mapping took "
+            << duration<double, std::micro>(applied - selected).count()
+            << " us" << std::endl;
+  return ok ? 0 : 1;
+}
+
+// Opens `path` for an evdev stream, with what went wrong on stderr if it
+// can't
+static int open_stream(std::string_view path, int flags,
+                       std::string_view failure) noexcept {
+  const auto file = std::string{path};
+  const auto fd = open(file.c_str(), flags | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    std::cerr << failure << " " << file << ": " << strerror(errno)
+              << std::endl;
+  }
+  return fd;
+}
+
+int ApplicationState::openDeviceEvents() noexcept {
+  initX11();
+  auto config = parse_config(cliArgs);
+  if (!config) {
+    auto device = selectDevice();
+    if (!device) {
+      std::cout << " you picked an invalid option\n";
+      return -1;
+    }
+    config = WacomConfig{.deviceName = std::string{device->id}};
+  }
+  const auto id = xi::find_device_id(connection, config->deviceName);
+  const auto node = id ? xi::device_node(connection, id.value())
+                       : std::optional<std::string>{};
+  if (!node) {
+    std::cerr << "No evdev node known for device '" << config->deviceName
+              << "'" << std::endl;
+    return -1;
+  }
+  const auto fd = open(node->c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd == -1) {
+    std::cerr << "Can't open " << node.value() << ": " << strerror(errno)
+              << std::endl;
+    return -1;
+  }
+  // Report times on the monotonic clock, so an NTP step can't show up as a
+  // stutter
+  int clock = CLOCK_MONOTONIC;
+  ioctl(fd, EVIOCSCLOCKID, &clock);
+  std::cout << "Reading " << config->deviceName << " from " << node.value()
+            << std::endl;
+  return fd;
+}
+
+int ApplicationState::runAnalyze() noexcept {
+  using namespace std::chrono;
+  const auto live = !cliArgs.dumpFile;
+  int input = -1;
+  if (!live) {
+    input = open_stream(cliArgs.dumpFile.value(), O_RDONLY,
+                        "Can't read evdev dump");
+    if (input == -1) {
+      return 1;
+    }
+  } else {
+    input = openDeviceEvents();
+    if (input == -1) {
+      return 1;
+    }
+    std::cout << "Analyzing, Ctrl-C to stop" << std::endl;
+  }
+
+  auto dump =
+      cliArgs.recordFile
+          ? open_stream(cliArgs.recordFile.value(),
+                        O_WRONLY | O_CREAT | O_TRUNC, "Can't record to")
+          : -1;
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &signals, nullptr);
+  const auto signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  std::array<pollfd, 2> fds{pollfd{input, POLLIN, 0},
+                            pollfd{signalFd, POLLIN, 0}};
+
+  // Redraw the statistics in place a couple of times a second on a terminal;
+  // otherwise print them once at the end.
+  constexpr auto RedrawInterval = 500ms;
+  const auto interactive = live && isatty(STDOUT_FILENO);
+  auto drawn = 0;
+  auto nextDraw = steady_clock::now() + RedrawInterval;
+  PenAnalyzer analyzer{};
+  const auto draw = [&]() noexcept {
+    if (drawn > 0) {
+      std::cout << "\x1b[" << drawn << "F\x1b[J";
+    }
+    drawn = print_analysis(std::cout, analyzer);
+    nextDraw = steady_clock::now() + RedrawInterval;
+  };
+
+  std::array<input_event, PenAnalyzer::BatchSize> batch{};
+  auto ok = true;
+  for (auto running = true; running;) {
+    const auto bytes = read(input, batch.data(), sizeof(batch));
+    if (bytes > 0) {
+      // evdev only hands out whole events; a dump may end in part of one
+      const auto count = static_cast<std::size_t>(bytes) / sizeof(input_event);
+      analyzer.feed(std::span{batch.data(), count});
+      if (dump != -1 &&
+          write(dump, batch.data(), count * sizeof(input_event)) == -1) {
+        std::cerr << "Recording failed: " << strerror(errno) << std::endl;
+        close(dump);
+        dump = -1;
+      }
+      if (interactive && steady_clock::now() >= nextDraw) {
+        draw();
+      }
+      continue;
+    }
+    if (bytes == 0) {
+      break;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN) {
+      // ENODEV once the tablet is unplugged
+      std::cerr << "Reading events failed: " << strerror(errno) << std::endl;
+      ok = false;
+      break;
+    }
+    const auto wait = interactive ? duration_cast<milliseconds>(
+                                        nextDraw - steady_clock::now())
+                                        .count()
+                                  : -1;
+    if (poll(fds.data(), fds.size(), interactive ? std::max(0L, wait) : -1) ==
+            -1 &&
+        errno != EINTR) {
+      FATAL("poll failed");
+    }
+    if (fds[1].revents & POLLIN) {
+      running = false;
+    } else if (interactive && steady_clock::now() >= nextDraw) {
+      draw();
+    }
+  }
+  if (interactive) {
+    draw();
+  } else {
+    print_analysis(std::cout, analyzer);
+  }
+  if (dump != -1) {
+    close(dump);
+  }
+  close(signalFd);
+  close(input);
+  return ok ? 0 : 1;
+}
+
+int ApplicationState::runSmooth() noexcept {
+  using namespace std::chrono;
+  const auto filter = filter_from_string(cliArgs.smoothFilter);
+  if (!filter) {
+    std::cerr << "Invalid filter '" << cliArgs.smoothFilter << "'"
+              << std::endl;
+    usageError(1);
+  }
+  int input = -1;
+  std::optional<VirtualTablet> tablet{};
+  if (cliArgs.dumpFile) {
+    input = open_stream(cliArgs.dumpFile.value(), O_RDONLY,
+                        "Can't read evdev dump");
+    if (input == -1) {
+      return 1;
+    }
+  } else {
+    input = openDeviceEvents();
+    if (input == -1) {
+      return 1;
+    }
+    tablet.emplace(input);
+    if (!tablet->isOpen()) {
+      std::cerr << "Can't create a uinput device: " << strerror(errno)
+                << std::endl;
+      close(input);
+      return 1;
+    }
+    // From here on only we see the real tablet, X sees the virtual one
+    if (ioctl(input, EVIOCGRAB, 1) == -1) {
+      std::cerr << "Can't grab the tablet: " << strerror(errno) << std::endl;
+      close(input);
+      return 1;
+    }
+    std::cout << "Smoothed events come from '" << tablet->name()
+              << "', map that device. Ctrl-C to stop" << std::endl;
+  }
+  const auto output =
+      cliArgs.recordFile
+          ? open_stream(cliArgs.recordFile.value(),
+                        O_WRONLY | O_CREAT | O_TRUNC, "Can't record to")
+          : -1;
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &signals, nullptr);
+  const auto signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  std::array<pollfd, 2> fds{pollfd{input, POLLIN, 0},
+                            pollfd{signalFd, POLLIN, 0}};
+
+  // Too big for comfort on the stack, allocated once up front
+  const auto smoother = std::make_unique<Smoother>(filter.value());
+  std::array<input_event, Smoother::BatchSize> batch{};
+  std::uint64_t events = 0;
+  nanoseconds busy{0};
+  nanoseconds slowest{0};
+  auto ok = true;
+  for (auto running = true; running;) {
+    const auto bytes = read(input, batch.data(), sizeof(batch));
+    if (bytes > 0) {
+      const auto count = static_cast<std::size_t>(bytes) / sizeof(input_event);
+      const auto started = steady_clock::now();
+      const auto ready = smoother->process(std::span{batch.data(), count});
+      if (tablet && !tablet->emit(ready)) {
+        std::cerr << "Writing events failed: " << strerror(errno) << std::endl;
+        ok = false;
+        break;
+      }
+      // Everything read at once waits for the whole batch, so the slowest
+      // batch is the most latency added to any event
+      const auto took = steady_clock::now() - started;
+      busy += took;
+      slowest = std::max(slowest, duration_cast<nanoseconds>(took));
+      events += count;
+      if (output != -1 &&
+          write(output, ready.data(), ready.size_bytes()) == -1) {
+        std::cerr << "Recording failed: " << strerror(errno) << std::endl;
+      }
+      continue;
+    }
+    if (bytes == 0) {
+      break;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN) {
+      std::cerr << "Reading events failed: " << strerror(errno) << std::endl;
+      ok = false;
+      break;
+    }
+    if (poll(fds.data(), fds.size(), -1) == -1 && errno != EINTR) {
+      FATAL("poll failed");
+    }
+    running = !(fds[1].revents & POLLIN);
+  }
+  std::cout << "Filtered " << events << " events, "
+            << (events > 0 ? duration<double, std::nano>(busy).count() / events
+                           : 0.0)
+            << " ns per event on average, at most "
+            << duration<double, std::micro>(slowest).count()
+            << " us added to any event" << std::endl;
+  if (output != -1) {
+    close(output);
+  }
+  close(signalFd);
+  // which also lets go of the grab
+  close(input);
+  return ok ? 0 : 1;
+}
+
+int ApplicationState::runBatch() noexcept {
+  auto input = STDIN_FILENO;
+  if (cliArgs.batchFile && cliArgs.batchFile.value() != "-"sv) {
+    input = open_stream(cliArgs.batchFile.value(), O_RDONLY,
+                        "Can't read batch file");
+    if (input == -1) {
+      return 1;
+    }
+  }
+  // Real devices are set through XInput 2 where possible, which beats
+  // spawning xsetwacom per setting
+  if (!mockBackend) {
+    initX11();
+  }
+  BatchParser parser{[this](std::string_view name) -> std::optional<Selection> {
+    const auto *monitor =
+        openDisplay() ? monitors.find(connection, name) : nullptr;
+    return monitor ? std::optional{monitor->geometry} : std::nullopt;
+  }};
+
+  std::vector<char> buffer(64 * 1024);
+  auto ended = false;
+  const auto readInput = [&]() noexcept {
+    const auto bytes = ::read(input, buffer.data(), buffer.size());
+    if (bytes > 0) {
+      parser.feed(std::string_view{buffer.data(),
+                                   static_cast<std::size_t>(bytes)});
+    } else if (bytes == 0 || errno != EINTR) {
+      ended = true;
+      parser.finish();
+    }
+  };
+  // While the loop waits on the backend for one batch, whatever arrives on
+  // a pipe or terminal is parsed into the next. epoll can't watch files,
+  // which read fast enough anyway.
+  struct stat info {};
+  auto watching = fstat(input, &info) == 0 && !S_ISREG(info.st_mode);
+  if (watching) {
+    loop.watch(input, [&]() noexcept {
+      readInput();
+      if (ended) {
+        loop.unwatch(input);
+        watching = false;
+      }
+    });
+  }
+
+  auto *manager = WacomDeviceManager::getDeviceManager();
+  auto failed = false;
+  while (!ended || parser.pending() > 0) {
+    if (parser.pending() == 0) {
+      readInput();
+      continue;
+    }
+    const auto entries = parser.take();
+    std::vector<WacomCommand> commands{};
+    for (const auto &entry : entries) {
+      if (entry.command && entry.supersededBy == 0) {
+        commands.push_back(entry.command.value());
+      }
+    }
+    const auto results =
+        perform_commands(loop, manager->backend(), commands, &connection);
+    auto result = results.begin();
+    for (const auto &entry : entries) {
+      const auto performed = entry.command && entry.supersededBy == 0;
+      const auto outcome = performed ? *result++ : CommandResult::Ok;
+      failed = failed || !entry.command || outcome != CommandResult::Ok;
+      print_batch_result(std::cout, entry, outcome);
+    }
+    std::cout.flush();
+  }
+  if (watching) {
+    loop.unwatch(input);
+  }
+  if (input != STDIN_FILENO) {
+    close(input);
+  }
+  return failed ? 1 : 0;
+}
+
+int ApplicationState::runMapping() noexcept {
+  auto config = parse_config(cliArgs);
+  if (!config) {
+    auto device = selectDevice();
+    if (!device) {
+      std::cout << " you picked an invalid option\n";
+      return 1;
+    }
+    config = WacomConfig{.deviceName = std::string{device->id}};
+  }
+  config->keepAspect = cliArgs.keepAspect;
+  config->rotation = cliArgs.rotation;
+  config->pressureCurve = cliArgs.pressureCurve;
+
+  if (cliArgs.mode == AppMode::FollowWindow) {
+    return runFollowWindow(config.value());
+  }
+
+  const auto select = selectArea();
+  auto ok = select && configure(config.value(), select.value());
+  if (ok && cliArgs.saveAs) {
+    ok = saveProfile(cliArgs.saveAs.value(), config.value(), select.value());
+  }
+  return ok ? 0 : 1;
+}
+
+void ApplicationState::writeTrace() const noexcept {
+  if (!cliArgs.traceFile) {
+    return;
+  }
+  std::ofstream out{std::string{cliArgs.traceFile.value()}};
+  trace::write_chrome_trace(out);
+  if (!out) {
+    std::cerr << "Could not write trace to " << cliArgs.traceFile.value()
+              << std::endl;
+  }
+}
+
+int ApplicationState::run() noexcept {
+  const WacomDeviceManager::Scope scope{deviceManager};
+  // Only open X for what talks to it: listing profiles never does, applying
+  // one does once it knows there's something to apply.
+  switch (cliArgs.mode) {
+  case AppMode::Daemon:
+    deviceManager.setResident(true);
+    initX11();
+    return runDaemon();
+  case AppMode::Server:
+    deviceManager.setResident(true);
+    initX11();
+    return runServer();
+  case AppMode::ApplyProfile:
+    return applyProfile(cliArgs.profile) ? 0 : 1;
+  case AppMode::AutoSwitch:
+    deviceManager.setResident(true);
+    initX11();
+    return runAutoSwitch();
+  case AppMode::ListProfiles:
+    listProfiles();
+    return 0;
+  case AppMode::Replay:
+    // headless; the mapping goes through the backend
+    return runReplay();
+  case AppMode::Analyze:
+    // only opens X to find a live device's node
+    return runAnalyze();
+  case AppMode::Smooth:
+    return runSmooth();
+  case AppMode::Batch:
+    deviceManager.setResident(true);
+    return runBatch();
+  case AppMode::Map:
+  case AppMode::FollowWindow:
+    break;
+  }
+  initX11();
+  return runMapping();
+}
+
+/*static*/ std::optional<int>
+ApplicationState::forward(int argc, const char **argv) noexcept {
+  auto args = createArgs(argc, argv);
+  // The server has the real devices, not the ones a mock run asked for
+  if (!control::is_forwardable(args) || std::getenv("WU_MOCK_BACKEND")) {
+    return {};
+  }
+  // The server serves many displays; ask for ours
+  if (const auto *display = std::getenv("DISPLAY");
+      args.displays.empty() && display != nullptr) {
+    args.displays.push_back(display);
+  }
+  return control::forward(control::socket_path(), args);
+}
+
+void ApplicationState::processBackgroundEvents() noexcept {
+  // Pull in what the server sent so the fd stops being readable, then take
+  // out just the events that aren't part of an interaction.
+  XEventsQueued(connection.display, QueuedAfterReading);
+  const auto isBackground = [](Display *, XEvent *event, XPointer self) -> Bool {
+    const auto *app = reinterpret_cast<const ApplicationState *>(self);
+    return app->monitors.isEvent(*event) ||
+           (event->type == GenericEvent &&
+            event->xcookie.extension == app->connection.xiOpcode);
+  };
+  XEvent event;
+  while (XCheckIfEvent(connection.display, &event, isBackground,
+                       reinterpret_cast<XPointer>(this))) {
+    handleEvent(event);
   }
-  return std::unexpected{"Could not find xsetwacom on $PATH"};
 }
 
 /*static*/ void ApplicationState::Initialize(int argc,
                                              const char **argv) noexcept {
   std::call_once(AppStateInitFlag, [=]() {
-    Instance = new ApplicationState{createArgs(argc, argv)};
-    WacomDeviceManager::getDeviceManager()->updateDeviceList();
-    Instance->initX11();
+    auto args = createArgs(argc, argv);
+    if (args.traceFile) {
+      trace::enable();
+    }
+    WU_TRACE_SPAN(trace::Point::AppInit);
+    // A server talks to its displays from several threads
+    if (args.mode == AppMode::Server) {
+      XInitThreads();
+    }
+    // X and the device list are set up by whatever needs them first
+    Instance = std::make_unique<ApplicationState>(std::move(args));
   });
 }
 
@@ -183,4 +1853,6 @@ ApplicationState::verifyHasXSetWacom() noexcept {
   return *Instance;
 }
 
-ApplicationState *ApplicationState::Instance = nullptr;
\ No newline at end of file
+/*static*/ void ApplicationState::Shutdown() noexcept { Instance.reset(); }
+
+std::unique_ptr<ApplicationState> ApplicationState::Instance = nullptr;
\ No newline at end of file
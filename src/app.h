@@ -1,9 +1,18 @@
 #pragma once
+#include "analyze.h"
+#include "backend.h"
+#include "batch.h"
+#include "eventlog.h"
 #include "selection.h"
+#include "smooth.h"
+#include "loop.h"
+#include "monitors.h"
+#include "pool.h"
+#include "profiles.h"
 #include "wacom.h"
-#include <X11/Xlib.h>
-#include <expected>
+#include "x11.h"
 #include <filesystem>
+#include <memory>
 #include <optional>
 #include <span>
 #include <string_view>
@@ -11,17 +20,54 @@
 
 namespace fs = std::filesystem;
 
-struct X11Connection {
-  Display *display{nullptr};
-  int screen{0};
-  Window root{0};
-
-  auto isOpen() const noexcept -> bool;
-  auto grabPointer() const noexcept -> void;
-  auto ungrabPointer() const noexcept -> void;
+enum class AppMode {
+  Map,
+  Daemon,
+  ApplyProfile,
+  ListProfiles,
+  AutoSwitch,
+  FollowWindow,
+  Server,
+  Replay,
+  Analyze,
+  Smooth,
+  Batch
 };
 
 struct ApplicationCliArgs {
+  AppMode mode{AppMode::Map};
+  bool keepAspect{false};
+  // Map every tool of the selected device's tablet, not just the device
+  bool wholeTablet{false};
+  // Map to this RandR output instead of asking for a selection
+  std::optional<std::string_view> output{};
+  // --save NAME: also store the mapping as profile NAME
+  std::optional<std::string_view> saveAs{};
+  // --rotate, --pressure-curve: set alongside the mapping
+  std::optional<TabletRotation> rotation{};
+  std::optional<PressureCurve> pressureCurve{};
+  // --apply NAME: the profile to apply
+  std::string_view profile{};
+  // --trace FILE: where to write the trace when done
+  std::optional<std::string_view> traceFile{};
+  // --record FILE: log the selection's pointer events to FILE, or with
+  // --analyze the raw evdev stream
+  std::optional<std::string_view> recordFile{};
+  // --replay FILE: the log to replay, and whether to keep its timing
+  std::string_view replayFile{};
+  bool realtime{false};
+  // --analyze/--smooth --dump FILE: read a recorded evdev stream instead of
+  // a device
+  std::optional<std::string_view> dumpFile{};
+  // --smooth [FILTER]
+  std::string_view smoothFilter{"one-euro"};
+  // --batch [FILE]: the commands to run, stdin when not given or "-"
+  std::optional<std::string_view> batchFile{};
+  // --display NAME: the X display to work on instead of $DISPLAY; a server
+  // serves every one given
+  std::vector<std::string_view> displays{};
+  // --auto [RULES]: rule file, or the default one
+  std::optional<std::string_view> rulesPath{};
   std::vector<std::string_view> cliArgs;
   operator std::span<const std::string_view>() const noexcept;
   // operator std::span<const std::string_view>() const noexcept {
@@ -30,16 +76,45 @@ struct ApplicationCliArgs {
   // }
 };
 
+// Everything wu knows about one X display: the connection, its monitors,
+// devices and the loop commands for them run on. A process normally has one,
+// a server one per display it serves, each used by one thread at a time.
 class ApplicationState {
-  static ApplicationState *Instance;
+  static std::unique_ptr<ApplicationState> Instance;
   ApplicationCliArgs cliArgs;
+  // $DISPLAY when empty
+  std::string displayName;
   X11Connection connection;
-  fs::path wacomConfigurePath;
+  MonitorLayout monitors;
+  // Runs commands that spawn xsetwacom, servicing X in the meantime
+  EventLoop loop;
+  // This display's devices, what getDeviceManager() returns while run() and
+  // the server's jobs for this display work
+  WacomDeviceManager deviceManager;
+  // xsetwacom for a display other than $DISPLAY
+  std::unique_ptr<XSetWacomBackend> xsetwacom;
+  // $WU_MOCK_BACKEND devices, stand-ins for the real ones
+  std::unique_ptr<WacomBackend> mockBackend;
+  // Opens the display if it isn't open yet. Only what talks to X calls it,
+  // so --profiles and friends never connect. Exits if it can't.
   auto initX11() noexcept -> void;
+  // Like initX11, but says whether it could
+  auto openDisplay() noexcept -> bool;
+  // Returns false when the daemon should exit
+  auto handleDaemonRequest(std::string_view line) noexcept -> bool;
+  // Serves one request from a client of the control socket, then closes it
+  auto serveControlRequest(int client, std::span<const char> request) noexcept
+      -> void;
+  // Opens the evdev node of the device on the command line (or one picked
+  // from the list) for non-blocking reads, -1 if it can't
+  auto openDeviceEvents() noexcept -> int;
+  // The default mode: map a device to an area
+  auto runMapping() noexcept -> int;
 
 public:
-  explicit ApplicationState(ApplicationCliArgs &&args) noexcept
-      : cliArgs(std::move(args)), connection() {}
+  // On `display`, or the first --display of `args`, or $DISPLAY
+  explicit ApplicationState(ApplicationCliArgs &&args,
+                            std::string display = {}) noexcept;
 
   ~ApplicationState() noexcept;
 
@@ -49,11 +124,80 @@ public:
   // User-facing application features
   auto selectDevice() const noexcept -> std::optional<WacomDevice>;
   auto selectScreenArea() noexcept -> Selection;
+  // Feeds a recorded event log to the selection like selectScreenArea feeds
+  // it live, either as fast as possible or at the recorded pace. Nothing if
+  // the log doesn't hold a complete selection.
+  auto replaySelection(std::span<const EventRecord> events,
+                       bool realtime) noexcept -> std::optional<Selection>;
+  // The geometry of the --output monitor if one was given, otherwise
+  // whatever the user selects with selectScreenArea
+  auto selectArea() noexcept -> std::optional<Selection>;
   auto configureWacomMapping(const WacomConfig &cfg,
                              Selection selection) noexcept -> bool;
+  // Maps every tool (stylus, eraser, touch, ...) of the tablet that
+  // `cfg.deviceName` belongs to, and reports the result per tool.
+  auto configureTabletMapping(const WacomConfig &cfg,
+                              Selection selection) noexcept -> bool;
+  // Dispatches to one of the above depending on --tablet
+  auto configure(const WacomConfig &cfg, Selection selection) noexcept -> bool;
+
+  // Stores the mapping as profile `name` in the profile store
+  auto saveProfile(std::string_view name, const WacomConfig &cfg,
+                   Selection selection) const noexcept -> bool;
+  // Applies every mapping of profile `name` in one batch
+  auto applyProfile(std::string_view name) noexcept -> bool;
+  auto applyProfile(const ProfileStore &store, std::string_view name) noexcept
+      -> bool;
+  auto listProfiles() const noexcept -> void;
+
+  // --replay: replays the log, maps the device to what it selects and
+  // reports how long that took
+  auto runReplay() noexcept -> int;
+  // --analyze: reads the device's evdev node (or a dump of one) and reports
+  // its report rate, jitter and noise, live on a terminal, until interrupted
+  auto runAnalyze() noexcept -> int;
+  // --smooth: filters the device's reports into a virtual tablet until
+  // interrupted, or a dump of them into --record
+  auto runSmooth() noexcept -> int;
+  // --batch: performs the commands read from a file or stdin, printing one
+  // result line per command; stdin is parsed while earlier commands run
+  auto runBatch() noexcept -> int;
+
+  // Runs whatever the command line asked for, returns the exit code
+  auto run() noexcept -> int;
+  // Writes the trace to the --trace file, if there is one
+  auto writeTrace() const noexcept -> void;
+
+  // Resident mode: keeps the X connection and the device list alive and
+  // serves map requests read line by line from stdin until `quit` or EOF.
+  auto runDaemon() noexcept -> int;
+  // Resident mode: serves other wu invocations over the control socket
+  // until SIGINT or SIGTERM, on whichever display each asks for. Every
+  // display is served on a small thread pool, so one doesn't wait for
+  // another.
+  auto runServer() noexcept -> int;
+  // Applies the profile the rule table assigns to the focused application
+  // whenever focus moves, until interrupted.
+  auto runAutoSwitch() noexcept -> int;
+  // Lets the user click a window, returns its client window
+  auto selectWindow() noexcept -> Window;
+  // Keeps `cfg` mapped to a window the user picks, following it as it moves
+  // or resizes, until the window goes away.
+  auto runFollowWindow(const WacomConfig &cfg) noexcept -> int;
+  // Handles events that aren't part of any interaction, like device hotplug
+  auto handleEvent(XEvent &event) noexcept -> void;
+  auto processPendingEvents() noexcept -> void;
+  // Handles only the events of handleEvent, leaving everything else queued
+  // for whichever interaction is running. Called while commands run.
+  auto processBackgroundEvents() noexcept -> void;
 
-  auto static verifyHasXSetWacom() noexcept
-      -> std::expected<fs::path, const char *>;
+  // Hands the command line to a running server if there is one, and returns
+  // its exit code. Nothing means we have to do the work ourselves.
+  auto static forward(int argc, const char **argv) noexcept
+      -> std::optional<int>;
   auto static Initialize(int argc, const char **argv) noexcept -> void;
   auto static getAppInstance() noexcept -> ApplicationState &;
+  // Tears down the application state (closes the X display). Safe to call
+  // more than once.
+  auto static Shutdown() noexcept -> void;
 };
\ No newline at end of file
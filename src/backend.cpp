@@ -0,0 +1,460 @@
+#include "backend.h"
+#include "loop.h"
+#include "pacer.h"
+#include "toolpath.h"
+#include "trace.h"
+#include "xinput.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+std::vector<CommandResult>
+WacomBackend::apply(EventLoop &loop,
+                    std::span<const WacomCommand> commands) noexcept {
+  std::vector<CommandResult> results(commands.size(), CommandResult::NotKnown);
+  for (auto i = 0uz; i < commands.size(); ++i) {
+    loop.spawn([](WacomBackend &backend, EventLoop &loop,
+                  const WacomCommand &command,
+                  CommandResult &result) -> Task<void> {
+      result = co_await backend.set(loop, command);
+    }(*this, loop, commands[i], results[i]));
+  }
+  loop.run();
+  return results;
+}
+
+const std::string &XSetWacomBackend::path() noexcept {
+  if (binary.empty()) {
+    const auto found =
+        toolpath::find("xsetwacom", toolpath::cache_path("xsetwacom"));
+    if (found) {
+      binary = found->native();
+    } else {
+      std::cerr << "xsetwacom: " << found.error() << std::endl;
+      // let the spawn fail the usual way
+      binary = "xsetwacom";
+    }
+  }
+  return binary;
+}
+
+std::vector<std::string>
+XSetWacomBackend::arguments(std::vector<std::string> args) const noexcept {
+  if (!display.empty()) {
+    args.insert(args.begin(), {"--display", display});
+  }
+  return args;
+}
+
+DeviceList XSetWacomBackend::enumerate() noexcept {
+  const auto args = arguments({"--list", "devices"});
+  ExecResult::run(path(), args, listing);
+  if (const auto err = listing.spawn_error(); err) {
+    std::cerr << "reading device list failed: " << strerror(err) << std::endl;
+    return {};
+  }
+  return parse_devices(listing.std_out());
+}
+
+static std::vector<std::string>
+xsetwacom_args(const MapToAreaCommand &cmd) noexcept {
+  std::vector<std::string> args{};
+  args.reserve(4);
+  args.push_back("set");
+  args.push_back(cmd.config.deviceName);
+  args.push_back("maptooutput");
+  args.push_back(geometry(cmd.sel).str());
+  return args;
+}
+
+static std::vector<std::string>
+xsetwacom_args(const SetRotationCommand &cmd) noexcept {
+  return {"set", cmd.deviceName, "Rotate",
+          std::string{to_string(cmd.rotation)}};
+}
+
+static std::vector<std::string>
+xsetwacom_args(const SetPressureCurveCommand &cmd) noexcept {
+  const auto [x1, y1, x2, y2] = cmd.curve;
+  return {"set",
+          cmd.deviceName,
+          "PressureCurve",
+          std::to_string(x1),
+          std::to_string(y1),
+          std::to_string(x2),
+          std::to_string(y2)};
+}
+
+// The XInput id of `device` when the device manager's list has it, which is
+// what its snapshot goes by. Doesn't list devices for it: a one-shot run
+// that names a device never has to.
+static std::optional<int> snapshot_id(std::string_view device) noexcept {
+  const auto *found =
+      WacomDeviceManager::getDeviceManager()->peekDevice(device);
+  int id;
+  if (found == nullptr ||
+      std::from_chars(found->id.data(), found->id.data() + found->id.size(),
+                      id)
+              .ec != std::errc()) {
+    return {};
+  }
+  return id;
+}
+
+// The snapshot of device `id`. Looked up afresh after every co_await: other
+// commands in flight may add snapshots meanwhile, which moves them.
+static DeviceParameters &snapshot(int id) noexcept {
+  return WacomDeviceManager::getDeviceManager()->parameters(id);
+}
+
+// Whether reading a setting only to fill in a snapshot is worth a spawn
+static bool resident() noexcept {
+  return WacomDeviceManager::getDeviceManager()->isResident();
+}
+
+Task<bool> XSetWacomBackend::setArea(EventLoop &loop,
+                                     const MapToAreaCommand &cmd,
+                                     std::optional<int> id) noexcept {
+  const auto &device = cmd.config.deviceName;
+  auto native = id ? snapshot(*id).nativeArea : std::nullopt;
+  if (!native) {
+    // The whole tablet, which is also what keep aspect crops from
+    auto resetArgs = arguments({"set", device, "ResetArea"});
+    const auto reset =
+        co_await ExecResult::execAsync(loop, path(), std::move(resetArgs));
+    if (!reset->succcess()) {
+      co_return false;
+    }
+    if (!cmd.config.keepAspect && !(id && resident())) {
+      co_return true;
+    }
+    const auto full = co_await get(loop, device, Parameter::Area);
+    if (!full) {
+      co_return !cmd.config.keepAspect;
+    }
+    native = std::get<TabletArea>(full.value());
+    if (id) {
+      auto &params = snapshot(*id);
+      params.nativeArea = native;
+      params.area.wrote(native.value());
+    }
+  }
+  const auto desired =
+      cmd.config.keepAspect
+          ? xi::aspect_area(native.value(), cmd.sel.dimensions)
+          : native.value();
+  if (id ? snapshot(*id).area.value == desired : desired == native) {
+    co_return true;
+  }
+  const auto [x1, y1, x2, y2] = desired;
+  auto areaArgs =
+      desired == native
+          ? arguments({"set", device, "ResetArea"})
+          : arguments({"set", device, "Area", std::to_string(x1),
+                       std::to_string(y1), std::to_string(x2),
+                       std::to_string(y2)});
+  const auto area =
+      co_await ExecResult::execAsync(loop, path(), std::move(areaArgs));
+  if (id) {
+    auto &current = snapshot(*id).area;
+    if (area->succcess()) {
+      current.wrote(desired);
+    } else {
+      current.value.reset();
+    }
+  }
+  co_return area->succcess();
+}
+
+Task<bool> XSetWacomBackend::unchanged(EventLoop &loop, int id,
+                                       const WacomCommand &command) noexcept {
+  const auto device = std::string{command_device(command)};
+  if (const auto *map = std::get_if<MapToAreaCommand>(&command); map) {
+    // The matrix can't be read through xsetwacom, so only a mapping we set
+    // ourselves is known
+    const auto &params = snapshot(id);
+    if (!params.nativeArea || params.mapping.value != map->sel) {
+      co_return false;
+    }
+    co_return params.area.value ==
+        (map->config.keepAspect
+             ? xi::aspect_area(params.nativeArea.value(), map->sel.dimensions)
+             : params.nativeArea.value());
+  }
+  if (const auto *rotate = std::get_if<SetRotationCommand>(&command); rotate) {
+    if (!snapshot(id).rotation.value && resident()) {
+      const auto value = co_await get(loop, device, Parameter::Rotation);
+      if (value) {
+        snapshot(id).rotation.value = std::get<TabletRotation>(value.value());
+      }
+    }
+    co_return snapshot(id).rotation.value == rotate->rotation;
+  }
+  const auto &curve = std::get<SetPressureCurveCommand>(command).curve;
+  if (!snapshot(id).pressureCurve.value && resident()) {
+    const auto value = co_await get(loop, device, Parameter::PressureCurve);
+    if (value) {
+      snapshot(id).pressureCurve.value = std::get<PressureCurve>(value.value());
+    }
+  }
+  co_return snapshot(id).pressureCurve.value == curve;
+}
+
+Task<CommandResult> XSetWacomBackend::set(EventLoop &loop,
+                                          const WacomCommand &command) noexcept {
+  // Like the native path, leave alone what the device already has, so
+  // re-applying an unchanged profile spawns nothing
+  const auto id = snapshot_id(command_device(command));
+  if (id) {
+    const auto same = co_await unchanged(loop, id.value(), command);
+    if (same) {
+      co_return CommandResult::Ok;
+    }
+  }
+  if (const auto *map = std::get_if<MapToAreaCommand>(&command); map) {
+    const auto areaSet = co_await setArea(loop, *map, id);
+    if (!areaSet) {
+      co_return CommandResult::Error;
+    }
+    if (id && snapshot(*id).mapping.value == map->sel) {
+      co_return CommandResult::Ok;
+    }
+  }
+  auto args = std::visit(
+      [this](const auto &cmd) -> std::vector<std::string> {
+        WU_TRACE_SPAN(trace::Point::CommandBuild);
+        return arguments(xsetwacom_args(cmd));
+      },
+      command);
+  const auto result = co_await ExecResult::execAsync(loop, path(),
+                                                     std::move(args));
+  if (!result->succcess()) {
+    co_return CommandResult::Error;
+  }
+  if (id) {
+    auto &params = snapshot(*id);
+    std::visit(
+        [&params](const auto &cmd) noexcept {
+          using Command = std::decay_t<decltype(cmd)>;
+          if constexpr (std::is_same_v<Command, MapToAreaCommand>) {
+            params.mapping.wrote(cmd.sel);
+          } else if constexpr (std::is_same_v<Command, SetRotationCommand>) {
+            params.rotation.wrote(cmd.rotation);
+          } else {
+            params.pressureCurve.wrote(cmd.curve);
+          }
+        },
+        command);
+  }
+  co_return CommandResult::Ok;
+}
+
+// Four whitespace separated integers, as xsetwacom prints Area and
+// PressureCurve
+static std::optional<std::array<int, 4>>
+parse_four(std::string_view text) noexcept {
+  std::array<int, 4> result{};
+  const auto *it = text.data();
+  const auto *end = text.data() + text.size();
+  for (auto &value : result) {
+    while (it != end && (*it == ' ' || *it == '\t')) {
+      ++it;
+    }
+    const auto parse = std::from_chars(it, end, value);
+    if (parse.ec != std::errc()) {
+      return {};
+    }
+    it = parse.ptr;
+  }
+  return result;
+}
+
+Task<std::optional<ParameterValue>>
+XSetWacomBackend::get(EventLoop &loop, std::string_view device,
+                      Parameter parameter) noexcept {
+  constexpr std::string_view Names[]{"Area", "Rotate", "PressureCurve"};
+  auto args = arguments(
+      {"get", std::string{device},
+       std::string{Names[static_cast<std::size_t>(parameter)]}});
+  const auto result =
+      co_await ExecResult::execAsync(loop, path(), std::move(args));
+  if (!result->succcess()) {
+    co_return std::nullopt;
+  }
+  auto output = result->std_out();
+  while (!output.empty() && (output.back() == '\n' || output.back() == ' ')) {
+    output.remove_suffix(1);
+  }
+  switch (parameter) {
+  case Parameter::Area:
+    if (const auto values = parse_four(output); values) {
+      const auto [x1, y1, x2, y2] = values.value();
+      co_return TabletArea{x1, y1, x2, y2};
+    }
+    break;
+  case Parameter::Rotation:
+    if (const auto rotation = rotation_from_string(output); rotation) {
+      co_return rotation.value();
+    }
+    break;
+  case Parameter::PressureCurve:
+    if (const auto curve = parse_four(output); curve) {
+      co_return curve.value();
+    }
+    break;
+  }
+  co_return std::nullopt;
+}
+
+/*static*/ XSetWacomBackend &XSetWacomBackend::instance() noexcept {
+  static XSetWacomBackend backend{};
+  return backend;
+}
+
+MockBackend::MockBackend(std::size_t tablets,
+                         std::chrono::microseconds latency) noexcept
+    : latency(latency) {
+  constexpr std::pair<std::string_view, WacomToolType> Tools[]{
+      {"Pen stylus", WacomToolType::Stylus},
+      {"Pen eraser", WacomToolType::Eraser},
+      {"Finger touch", WacomToolType::Touch},
+      {"Pad pad", WacomToolType::Pad}};
+  constexpr TabletArea NativeArea{0, 0, 15200, 9500};
+  // X hands out ids from 2, and the core devices take the first few
+  auto id = 10;
+  devices.reserve(tablets * std::size(Tools));
+  listed.reserve(tablets * std::size(Tools), 0);
+  for (auto tablet = 0uz; tablet < tablets; ++tablet) {
+    const auto name = "Wacom Mock Tablet " + std::to_string(tablet);
+    for (const auto &[tool, type] : Tools) {
+      listed.add(WacomDevice{.deviceName = name + " " + std::string{tool},
+                             .id = std::to_string(id++),
+                             .type = type});
+      devices.push_back(Device{.nativeArea = NativeArea, .area = NativeArea});
+    }
+  }
+  index.rebuild(listed);
+}
+
+MockBackend::Device *MockBackend::find(std::string_view nameOrId) noexcept {
+  const auto i = index.lookup(listed, nameOrId);
+  return i ? &devices[i.value()] : nullptr;
+}
+
+const MockBackend::Device *
+MockBackend::device(std::string_view nameOrId) const noexcept {
+  const auto i = index.lookup(listed, nameOrId);
+  return i ? &devices[i.value()] : nullptr;
+}
+
+CommandResult MockBackend::write(const WacomCommand &command) noexcept {
+  const auto visitor = [this](const auto &cmd) -> CommandResult {
+    using Command = std::decay_t<decltype(cmd)>;
+    if constexpr (std::is_same_v<Command, MapToAreaCommand>) {
+      auto *device = find(cmd.config.deviceName);
+      if (device == nullptr) {
+        return CommandResult::Error;
+      }
+      device->area =
+          cmd.config.keepAspect
+              ? xi::aspect_area(device->nativeArea, cmd.sel.dimensions)
+              : device->nativeArea;
+      device->mapping = cmd.sel;
+    } else if constexpr (std::is_same_v<Command, SetRotationCommand>) {
+      auto *device = find(cmd.deviceName);
+      if (device == nullptr) {
+        return CommandResult::Error;
+      }
+      device->rotation = cmd.rotation;
+    } else {
+      auto *device = find(cmd.deviceName);
+      if (device == nullptr) {
+        return CommandResult::Error;
+      }
+      device->pressureCurve = cmd.curve;
+    }
+    ++writes;
+    return CommandResult::Ok;
+  };
+  return std::visit(visitor, command);
+}
+
+Task<void> MockBackend::wait(EventLoop &loop) noexcept {
+  if (latency.count() == 0) {
+    co_return;
+  }
+  FramePacer timer{latency};
+  timer.restart(latency);
+  auto expired = loop.readable({timer.fd()});
+  co_await expired;
+  timer.consume();
+}
+
+DeviceList MockBackend::enumerate() noexcept { return listed; }
+
+Task<std::optional<ParameterValue>>
+MockBackend::get(EventLoop &loop, std::string_view device,
+                 Parameter parameter) noexcept {
+  co_await wait(loop);
+  const auto *found = find(device);
+  if (found == nullptr) {
+    co_return std::nullopt;
+  }
+  switch (parameter) {
+  case Parameter::Area:
+    co_return found->area;
+  case Parameter::Rotation:
+    co_return found->rotation;
+  case Parameter::PressureCurve:
+    co_return found->pressureCurve;
+  }
+  co_return std::nullopt;
+}
+
+Task<CommandResult> MockBackend::set(EventLoop &loop,
+                                     const WacomCommand &command) noexcept {
+  co_await wait(loop);
+  co_return write(command);
+}
+
+std::vector<CommandResult>
+MockBackend::apply(EventLoop &loop,
+                   std::span<const WacomCommand> commands) noexcept {
+  if (commands.empty()) {
+    return {};
+  }
+  std::vector<CommandResult> results{};
+  results.reserve(commands.size());
+  loop.spawn([](MockBackend &backend, EventLoop &loop) -> Task<void> {
+    co_await backend.wait(loop);
+  }(*this, loop));
+  loop.run();
+  for (const auto &command : commands) {
+    results.push_back(write(command));
+  }
+  return results;
+}
+
+/*static*/ std::unique_ptr<MockBackend> MockBackend::fromEnvironment() noexcept {
+  const auto *spec = std::getenv("WU_MOCK_BACKEND");
+  if (spec == nullptr || spec[0] == '\0') {
+    return nullptr;
+  }
+  const std::string_view text{spec};
+  std::size_t tablets = 0;
+  long latencyUs = 0;
+  const auto end = text.data() + text.size();
+  auto parse = std::from_chars(text.data(), end, tablets);
+  if (parse.ec == std::errc() && parse.ptr != end && *parse.ptr == ':') {
+    parse = std::from_chars(parse.ptr + 1, end, latencyUs);
+  }
+  if (parse.ec != std::errc() || parse.ptr != end || latencyUs < 0) {
+    std::cerr << "WU_MOCK_BACKEND should be TABLETS[:LATENCY_US], not '"
+              << text << "'" << std::endl;
+    return nullptr;
+  }
+  return std::make_unique<MockBackend>(tablets,
+                                       std::chrono::microseconds{latencyUs});
+}
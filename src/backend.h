@@ -0,0 +1,131 @@
+#pragma once
+#include "process.h"
+#include "task.h"
+#include "wacom.h"
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+class EventLoop;
+
+// The settings a backend can read back
+enum class Parameter { Area, Rotation, PressureCurve };
+using ParameterValue = std::variant<TabletArea, TabletRotation, PressureCurve>;
+
+// Whatever actually holds the tablet settings. WacomDeviceManager lists
+// devices through one, and perform_command hands it what it can't do
+// natively through XInput 2.
+class WacomBackend {
+public:
+  virtual ~WacomBackend() = default;
+
+  // Whether the devices are X input devices, which perform_command may then
+  // configure through their XInput 2 properties directly
+  virtual auto isXDevices() const noexcept -> bool { return false; }
+  virtual auto enumerate() noexcept -> DeviceList = 0;
+  // What the device with id or name `device` has for `parameter`
+  virtual auto get(EventLoop &loop, std::string_view device,
+                   Parameter parameter) noexcept
+      -> Task<std::optional<ParameterValue>> = 0;
+  virtual auto set(EventLoop &loop, const WacomCommand &command) noexcept
+      -> Task<CommandResult> = 0;
+  // Performs all of `commands`, one result per command in order. Sets them
+  // concurrently on `loop` unless a backend knows better.
+  virtual auto apply(EventLoop &loop,
+                     std::span<const WacomCommand> commands) noexcept
+      -> std::vector<CommandResult>;
+};
+
+// The real thing: spawns xsetwacom for everything
+class XSetWacomBackend final : public WacomBackend {
+  // Resolved on first use
+  std::string binary{};
+  // The X display xsetwacom talks to, $DISPLAY when empty
+  std::string display{};
+  // Output of the last `xsetwacom --list devices`, kept to re-use its buffer
+  ExecResult listing{};
+
+  // xsetwacom's arguments for `args` on our display
+  auto arguments(std::vector<std::string> args) const noexcept
+      -> std::vector<std::string>;
+  // Sets the Area a mapping implies: the whole tablet, or with keep aspect
+  // the part of it with the aspect ratio of the screen area. Skipped when
+  // the snapshot of device `id` says it's already set.
+  auto setArea(EventLoop &loop, const MapToAreaCommand &cmd,
+               std::optional<int> id) noexcept -> Task<bool>;
+  // Whether device `id` already has what `command` sets, going by its
+  // snapshot in the device manager. Where that's empty, a resident manager
+  // has it read through get() first.
+  auto unchanged(EventLoop &loop, int id, const WacomCommand &command) noexcept
+      -> Task<bool>;
+
+public:
+  explicit XSetWacomBackend(std::string display = {}) noexcept
+      : display(std::move(display)) {}
+
+  auto isXDevices() const noexcept -> bool override { return true; }
+  auto enumerate() noexcept -> DeviceList override;
+  auto get(EventLoop &loop, std::string_view device,
+           Parameter parameter) noexcept
+      -> Task<std::optional<ParameterValue>> override;
+  auto set(EventLoop &loop, const WacomCommand &command) noexcept
+      -> Task<CommandResult> override;
+  // The xsetwacom binary, found on $PATH the first time it's asked for
+  auto path() noexcept -> const std::string &;
+
+  // The one for $DISPLAY
+  static auto instance() noexcept -> XSetWacomBackend &;
+};
+
+// Devices that only exist in memory, for exercising the whole command
+// pipeline without a tablet (or an X server). Every get and set takes
+// `latency`, during which the caller is suspended on its loop like it would
+// be on xsetwacom; apply takes it once for the whole batch.
+class MockBackend final : public WacomBackend {
+public:
+  struct Device {
+    TabletArea nativeArea;
+    TabletArea area;
+    TabletRotation rotation{TabletRotation::Upright};
+    PressureCurve pressureCurve{0, 0, 100, 100};
+    std::optional<Selection> mapping{};
+  };
+
+private:
+  // same order as `devices`
+  DeviceList listed{};
+  DeviceIndex index{};
+  std::vector<Device> devices{};
+  std::chrono::microseconds latency;
+  std::size_t writes{0};
+
+  auto find(std::string_view nameOrId) noexcept -> Device *;
+  auto write(const WacomCommand &command) noexcept -> CommandResult;
+  auto wait(EventLoop &loop) noexcept -> Task<void>;
+
+public:
+  // `tablets` tablets with a stylus, eraser, touch and pad each, so four
+  // devices per tablet
+  MockBackend(std::size_t tablets, std::chrono::microseconds latency) noexcept;
+
+  auto enumerate() noexcept -> DeviceList override;
+  auto get(EventLoop &loop, std::string_view device,
+           Parameter parameter) noexcept
+      -> Task<std::optional<ParameterValue>> override;
+  auto set(EventLoop &loop, const WacomCommand &command) noexcept
+      -> Task<CommandResult> override;
+  auto apply(EventLoop &loop, std::span<const WacomCommand> commands) noexcept
+      -> std::vector<CommandResult> override;
+
+  auto device(std::string_view nameOrId) const noexcept -> const Device *;
+  // Number of settings changed so far
+  auto writeCount() const noexcept -> std::size_t { return writes; }
+
+  // From $WU_MOCK_BACKEND, "TABLETS[:LATENCY_US]", if it's set
+  static auto fromEnvironment() noexcept -> std::unique_ptr<MockBackend>;
+};
@@ -0,0 +1,153 @@
+#include "batch.h"
+#include <array>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+
+using namespace std::string_view_literals;
+
+// The next word of `line`, or the text between double quotes; consumed from
+// `line`
+static std::string_view next_word(std::string_view &line) noexcept {
+  constexpr auto Whitespace = " \t\r"sv;
+  const auto begin = line.find_first_not_of(Whitespace);
+  if (begin == std::string_view::npos) {
+    line = {};
+    return {};
+  }
+  line.remove_prefix(begin);
+  if (line.front() == '"') {
+    const auto close = line.find('"', 1);
+    const auto word = line.substr(1, close - 1);
+    line = close == std::string_view::npos ? std::string_view{}
+                                           : line.substr(close + 1);
+    return word;
+  }
+  const auto end = std::min(line.find_first_of(Whitespace), line.size());
+  const auto word = line.substr(0, end);
+  line.remove_prefix(end);
+  return word;
+}
+
+static std::expected<WacomCommand, std::string>
+parse_command(std::string_view line,
+              const BatchParser::OutputLookup &lookupOutput) noexcept {
+  const auto device = next_word(line);
+  const auto setting = next_word(line);
+  const auto value = next_word(line);
+  const auto option = next_word(line);
+  if (device.empty() || setting.empty() || value.empty()) {
+    return std::unexpected{"expected DEVICE SETTING VALUE"};
+  }
+  const auto mapping = setting == "area"sv || setting == "output"sv;
+  if (!next_word(line).empty() ||
+      (!option.empty() && (!mapping || option != "keep-aspect"sv))) {
+    return std::unexpected{"trailing arguments"};
+  }
+
+  if (mapping) {
+    const auto selection = setting == "area"sv ? selection_from_geometry(value)
+                                               : lookupOutput(value);
+    if (!selection) {
+      return std::unexpected{setting == "area"sv
+                                 ? "invalid geometry '" + std::string{value} +
+                                       "'"
+                                 : "no output '" + std::string{value} + "'"};
+    }
+    return MapToAreaCommand{
+        .config = WacomConfig{.deviceName = std::string{device},
+                              .keepAspect = !option.empty()},
+        .sel = selection.value()};
+  } else if (setting == "rotate"sv) {
+    if (const auto rotation = rotation_from_string(value); rotation) {
+      return SetRotationCommand{.deviceName = std::string{device},
+                                .rotation = rotation.value()};
+    }
+    return std::unexpected{"invalid rotation '" + std::string{value} + "'"};
+  } else if (setting == "pressure-curve"sv) {
+    if (const auto curve = pressure_curve_from_string(value); curve) {
+      return SetPressureCurveCommand{.deviceName = std::string{device},
+                                     .curve = curve.value()};
+    }
+    return std::unexpected{"invalid pressure curve '" + std::string{value} +
+                           "'"};
+  }
+  return std::unexpected{"unknown setting '" + std::string{setting} + "'"};
+}
+
+void BatchParser::parseLine(std::string_view line) noexcept {
+  ++lines;
+  auto rest = line;
+  const auto first = next_word(rest);
+  if (first.empty() || first.starts_with('#')) {
+    return;
+  }
+  entries.push_back(BatchEntry{.line = lines,
+                               .command = parse_command(line, lookupOutput)});
+}
+
+void BatchParser::feed(std::string_view chunk) noexcept {
+  for (auto newline = chunk.find('\n'); newline != std::string_view::npos;
+       newline = chunk.find('\n')) {
+    const auto line = chunk.substr(0, newline);
+    // Only a line straddling two chunks gets copied
+    if (partial.empty()) {
+      parseLine(line);
+    } else {
+      partial.append(line);
+      parseLine(partial);
+      partial.clear();
+    }
+    chunk.remove_prefix(newline + 1);
+  }
+  partial.append(chunk);
+}
+
+void BatchParser::finish() noexcept {
+  if (!partial.empty()) {
+    parseLine(partial);
+    partial.clear();
+  }
+}
+
+std::vector<BatchEntry> BatchParser::take() noexcept {
+  // Walking back from the end, the first entry of each kind for a device is
+  // the one that sticks; earlier ones would be overwritten right away. A
+  // device may be written by id on one line and by name on another, so go
+  // by the id of the device it resolves to.
+  auto *manager = WacomDeviceManager::getDeviceManager();
+  const auto device_key =
+      [manager](const WacomCommand &command) noexcept -> std::string_view {
+    const auto name = command_device(command);
+    const auto *device = manager->findDevice(name);
+    return device ? std::string_view{device->id} : name;
+  };
+  std::unordered_map<std::string_view,
+                     std::array<std::size_t, std::variant_size_v<WacomCommand>>>
+      latest{};
+  for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+    if (!it->command) {
+      continue;
+    }
+    auto &kinds = latest[device_key(it->command.value())];
+    auto &later = kinds[it->command->index()];
+    if (later != 0) {
+      it->supersededBy = later;
+    } else {
+      later = it->line;
+    }
+  }
+  return std::exchange(entries, {});
+}
+
+void print_batch_result(std::ostream &out, const BatchEntry &entry,
+                        CommandResult result) noexcept {
+  out << entry.line << ' ';
+  if (!entry.command) {
+    out << "error " << entry.command.error() << '\n';
+  } else if (entry.supersededBy != 0) {
+    out << "skipped " << entry.supersededBy << '\n';
+  } else {
+    out << (result == CommandResult::Ok ? "ok\n" : "failed\n");
+  }
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "wacom.h"
+#include <cstddef>
+#include <expected>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// `wu --batch`: settings for any number of devices read as a stream, one per
+// line, so a script pays for starting wu once rather than once per setting.
+//   # comment
+//   DEVICE area WxH+X+Y [keep-aspect]
+//   DEVICE output NAME [keep-aspect]
+//   DEVICE rotate none|cw|ccw|half
+//   DEVICE pressure-curve A,B,C,D
+// where DEVICE is an id or a name, in double quotes when it has spaces.
+
+struct BatchEntry {
+  // 1-based, in the whole stream
+  std::size_t line;
+  // What to do, or why the line can't be done
+  std::expected<WacomCommand, std::string> command;
+  // The line of a later entry setting the same thing on the same device,
+  // which makes this one redundant; 0 if there's none
+  std::size_t supersededBy{0};
+};
+
+// Parses a batch stream as it comes in, in chunks of any size
+class BatchParser {
+public:
+  // Where the RandR output `name` is on screen, if it's connected
+  using OutputLookup =
+      std::function<std::optional<Selection>(std::string_view name)>;
+
+private:
+  OutputLookup lookupOutput;
+  // the last line of the stream so far, if it has no newline yet
+  std::string partial{};
+  std::size_t lines{0};
+  std::vector<BatchEntry> entries{};
+
+  auto parseLine(std::string_view line) noexcept -> void;
+
+public:
+  explicit BatchParser(OutputLookup lookupOutput) noexcept
+      : lookupOutput(std::move(lookupOutput)) {}
+
+  // Parses every line `chunk` completes
+  auto feed(std::string_view chunk) noexcept -> void;
+  // End of stream: parses the last line, if it had no newline
+  auto finish() noexcept -> void;
+  // Number of entries parsed and not taken yet
+  auto pending() const noexcept -> std::size_t { return entries.size(); }
+  // Hands over the entries parsed so far, in order, with those a later one
+  // among them supersedes marked. Names are resolved through the device
+  // manager to tell when two lines are about the same device.
+  auto take() noexcept -> std::vector<BatchEntry>;
+};
+
+// One line per entry: "LINE ok", "LINE failed", "LINE skipped LATER" or
+// "LINE error MESSAGE". `result` is ignored for entries that weren't
+// performed.
+auto print_batch_result(std::ostream &out, const BatchEntry &entry,
+                        CommandResult result) noexcept -> void;
@@ -0,0 +1,337 @@
+#include "control.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace control {
+
+static constexpr char Magic[4]{'W', 'U', 'C', 'R'};
+static constexpr std::uint32_t Version = 2;
+
+fs::path socket_path() noexcept {
+  if (const auto runtime = std::getenv("XDG_RUNTIME_DIR");
+      runtime != nullptr && runtime[0] != '\0') {
+    return fs::path{runtime} / "wu.sock";
+  }
+  return fs::path{"/tmp"} / ("wu-" + std::to_string(getuid()) + ".sock");
+}
+
+bool is_forwardable(const ApplicationCliArgs &args) noexcept {
+  // the spans and events we'd want are in the server
+  if (args.traceFile || args.recordFile) {
+    return false;
+  }
+  switch (args.mode) {
+  case AppMode::ApplyProfile:
+    return true;
+  case AppMode::Map:
+    // Without a device we'd ask for one on the terminal, and without an
+    // output the area is dragged out: the server would hold the client
+    // through an interaction whose prompts and results it can't show
+    return !args.cliArgs.empty() && args.output.has_value();
+  default:
+    return false;
+  }
+}
+
+// Appends to a fixed buffer, remembering if anything didn't fit
+class RequestWriter {
+  std::span<char> buffer;
+  std::size_t size{0};
+  bool overflow{false};
+
+public:
+  explicit RequestWriter(std::span<char> buffer) noexcept : buffer(buffer) {}
+
+  void bytes(const void *data, std::size_t count) noexcept {
+    if (overflow || buffer.size() - size < count) {
+      overflow = true;
+      return;
+    }
+    std::memcpy(buffer.data() + size, data, count);
+    size += count;
+  }
+
+  void string(std::string_view str) noexcept {
+    const auto length = static_cast<std::uint32_t>(str.size());
+    bytes(&length, sizeof(length));
+    bytes(str.data(), str.size());
+  }
+
+  std::optional<std::size_t> finish() const noexcept {
+    return overflow ? std::nullopt : std::optional{size};
+  }
+};
+
+class RequestReader {
+  std::span<const char> request;
+  std::size_t offset{0};
+
+public:
+  explicit RequestReader(std::span<const char> request) noexcept
+      : request(request) {}
+
+  bool bytes(void *data, std::size_t count) noexcept {
+    if (request.size() - offset < count) {
+      return false;
+    }
+    std::memcpy(data, request.data() + offset, count);
+    offset += count;
+    return true;
+  }
+
+  std::optional<std::string_view> string() noexcept {
+    std::uint32_t length;
+    if (!bytes(&length, sizeof(length)) ||
+        request.size() - offset < length) {
+      return {};
+    }
+    const auto str = std::string_view{request.data() + offset, length};
+    offset += length;
+    return str;
+  }
+
+  bool atEnd() const noexcept { return offset == request.size(); }
+};
+
+std::optional<std::size_t> encode_request(const ApplicationCliArgs &args,
+                                          std::span<char> buffer) noexcept {
+  RequestHeader header{};
+  std::ranges::copy(Magic, header.magic);
+  header.version = Version;
+  header.mode = static_cast<std::uint32_t>(args.mode);
+  header.argCount = static_cast<std::uint32_t>(args.cliArgs.size());
+  if (args.keepAspect) {
+    header.flags |= RequestFlags::KeepAspect;
+  }
+  if (args.wholeTablet) {
+    header.flags |= RequestFlags::WholeTablet;
+  }
+  if (args.rotation) {
+    header.flags |= RequestFlags::HasRotation;
+    header.rotation = static_cast<std::int32_t>(args.rotation.value());
+  }
+  if (args.pressureCurve) {
+    header.flags |= RequestFlags::HasPressureCurve;
+    std::ranges::copy(args.pressureCurve.value(), header.pressureCurve);
+  }
+  if (args.output) {
+    header.flags |= RequestFlags::HasOutput;
+  }
+  if (args.saveAs) {
+    header.flags |= RequestFlags::HasSaveAs;
+  }
+  if (args.rulesPath) {
+    header.flags |= RequestFlags::HasRulesPath;
+  }
+  // The server only needs to know which display to work on
+  const auto display = args.displays.empty()
+                           ? std::optional<std::string_view>{}
+                           : std::optional{args.displays.front()};
+  if (display) {
+    header.flags |= RequestFlags::HasDisplay;
+  }
+
+  RequestWriter writer{buffer};
+  writer.bytes(&header, sizeof(header));
+  for (const auto &str : {args.output, args.saveAs,
+                          std::optional{args.profile}, args.rulesPath,
+                          display}) {
+    if (str) {
+      writer.string(str.value());
+    }
+  }
+  for (const auto arg : args.cliArgs) {
+    writer.string(arg);
+  }
+  return writer.finish();
+}
+
+std::optional<ApplicationCliArgs>
+decode_request(std::span<const char> request) noexcept {
+  RequestReader reader{request};
+  RequestHeader header;
+  if (!reader.bytes(&header, sizeof(header)) ||
+      !std::ranges::equal(header.magic, Magic) || header.version != Version ||
+      header.mode > static_cast<std::uint32_t>(AppMode::Server) ||
+      header.argCount > MaxRequestSize / sizeof(std::uint32_t)) {
+    return {};
+  }
+
+  ApplicationCliArgs args{};
+  args.mode = static_cast<AppMode>(header.mode);
+  args.keepAspect = (header.flags & RequestFlags::KeepAspect) != 0;
+  args.wholeTablet = (header.flags & RequestFlags::WholeTablet) != 0;
+  if (header.flags & RequestFlags::HasRotation) {
+    if (header.rotation < 0 || header.rotation > 3) {
+      return {};
+    }
+    args.rotation = static_cast<TabletRotation>(header.rotation);
+  }
+  if (header.flags & RequestFlags::HasPressureCurve) {
+    args.pressureCurve.emplace();
+    std::ranges::copy(header.pressureCurve, args.pressureCurve->begin());
+  }
+  const auto optional_string =
+      [&](RequestFlags flag,
+          std::optional<std::string_view> &into) noexcept -> bool {
+    if ((header.flags & flag) == 0) {
+      return true;
+    }
+    into = reader.string();
+    return into.has_value();
+  };
+  std::optional<std::string_view> profile{};
+  std::optional<std::string_view> display{};
+  if (!optional_string(RequestFlags::HasOutput, args.output) ||
+      !optional_string(RequestFlags::HasSaveAs, args.saveAs) ||
+      !(profile = reader.string()) ||
+      !optional_string(RequestFlags::HasRulesPath, args.rulesPath) ||
+      !optional_string(RequestFlags::HasDisplay, display)) {
+    return {};
+  }
+  args.profile = profile.value();
+  if (display) {
+    args.displays.push_back(display.value());
+  }
+  args.cliArgs.reserve(header.argCount);
+  for (auto i = 0u; i < header.argCount; ++i) {
+    const auto arg = reader.string();
+    if (!arg) {
+      return {};
+    }
+    args.cliArgs.push_back(arg.value());
+  }
+  if (!reader.atEnd()) {
+    return {};
+  }
+  return args;
+}
+
+static std::optional<sockaddr_un>
+socket_address(const fs::path &path) noexcept {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  const auto &native = path.native();
+  if (native.size() >= sizeof(address.sun_path)) {
+    return {};
+  }
+  std::ranges::copy(native, address.sun_path);
+  return address;
+}
+
+// A connected client socket, or -1 if nobody is listening on `path`
+static int connect_to(const fs::path &path) noexcept {
+  const auto address = socket_address(path);
+  if (!address) {
+    return -1;
+  }
+  const auto fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  if (connect(fd, reinterpret_cast<const sockaddr *>(&address.value()),
+              sizeof(sockaddr_un)) == -1) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+std::optional<int> forward(const fs::path &path,
+                           const ApplicationCliArgs &args) noexcept {
+  char buffer[MaxRequestSize];
+  const auto size = encode_request(args, buffer);
+  if (!size) {
+    return {};
+  }
+  const auto fd = connect_to(path);
+  if (fd == -1) {
+    return {};
+  }
+  std::optional<int> result{};
+  Response response;
+  if (send(fd, buffer, size.value(), MSG_NOSIGNAL) ==
+      static_cast<ssize_t>(size.value())) {
+    ssize_t received;
+    do {
+      received = recv(fd, &response, sizeof(response), 0);
+    } while (received == -1 && errno == EINTR);
+    if (received == sizeof(response)) {
+      result = response.exitCode;
+    } else {
+      std::cerr << "wu server went away without an answer" << std::endl;
+      result = 1;
+    }
+  }
+  close(fd);
+  return result;
+}
+
+Server::Server(fs::path path) noexcept : path(std::move(path)) {}
+
+Server::~Server() noexcept {
+  if (listenFd != -1) {
+    close(listenFd);
+    unlink(path.c_str());
+  }
+}
+
+bool Server::listen() noexcept {
+  const auto address = socket_address(path);
+  if (!address) {
+    std::cerr << "Socket path too long: " << path << std::endl;
+    return false;
+  }
+  if (const auto other = connect_to(path); other != -1) {
+    close(other);
+    std::cerr << "Another instance is already serving " << path << std::endl;
+    return false;
+  }
+  // Nobody answered, so whatever is there was left behind by a crash
+  unlink(path.c_str());
+
+  listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+  if (listenFd == -1) {
+    std::cerr << "socket failed: " << strerror(errno) << std::endl;
+    return false;
+  }
+  // Only our user may talk to us
+  const auto mask = umask(0077);
+  const auto bound =
+      bind(listenFd, reinterpret_cast<const sockaddr *>(&address.value()),
+           sizeof(sockaddr_un)) == 0;
+  umask(mask);
+  if (!bound || ::listen(listenFd, 8) == -1) {
+    std::cerr << "Could not listen on " << path << ": " << strerror(errno)
+              << std::endl;
+    close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+  return true;
+}
+
+int Server::accept() const noexcept {
+  const auto client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+  if (client == -1) {
+    return -1;
+  }
+  ucred credentials{};
+  socklen_t length = sizeof(credentials);
+  if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &credentials, &length) ==
+          -1 ||
+      credentials.uid != getuid()) {
+    close(client);
+    return -1;
+  }
+  return client;
+}
+} // namespace control
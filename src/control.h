@@ -0,0 +1,88 @@
+#pragma once
+#include "app.h"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+
+namespace fs = std::filesystem;
+
+// Control socket: a running `wu --server` owns a per-user Unix socket, and
+// any later `wu` invocation hands its parsed arguments to it instead of
+// opening the display and enumerating devices itself.
+//
+// A request is one SOCK_SEQPACKET message: a RequestHeader followed by the
+// strings of the arguments, each a uint32 length and its bytes, in the order
+// output, saveAs, profile, rulesPath, display (the optional ones only when
+// their flag is set) and then every positional argument. The reply is one
+// Response.
+namespace control {
+
+enum RequestFlags : std::uint32_t {
+  KeepAspect = 1 << 0,
+  WholeTablet = 1 << 1,
+  HasRotation = 1 << 2,
+  HasPressureCurve = 1 << 3,
+  HasOutput = 1 << 4,
+  HasSaveAs = 1 << 5,
+  HasRulesPath = 1 << 6,
+  HasDisplay = 1 << 7,
+};
+
+struct RequestHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t mode;
+  std::uint32_t flags;
+  std::int32_t rotation;
+  std::int32_t pressureCurve[4];
+  std::uint32_t argCount;
+};
+
+struct Response {
+  std::int32_t exitCode;
+};
+
+// Largest request we send or accept
+inline constexpr std::size_t MaxRequestSize = 4096;
+
+// $XDG_RUNTIME_DIR/wu.sock, or /tmp/wu-<uid>.sock
+auto socket_path() noexcept -> fs::path;
+
+// Whether a request in `mode` can be served by another instance; anything
+// long running or interactive (on the terminal or the screen) can't.
+auto is_forwardable(const ApplicationCliArgs &args) noexcept -> bool;
+
+// Writes `args` into `buffer`. Returns the request size, or nothing if it
+// doesn't fit.
+auto encode_request(const ApplicationCliArgs &args,
+                    std::span<char> buffer) noexcept
+    -> std::optional<std::size_t>;
+// The arguments in `request`; the string views point into `request`.
+auto decode_request(std::span<const char> request) noexcept
+    -> std::optional<ApplicationCliArgs>;
+
+// Sends `args` to the instance listening on `path` and waits for its exit
+// code. Nothing if no instance is listening.
+auto forward(const fs::path &path, const ApplicationCliArgs &args) noexcept
+    -> std::optional<int>;
+
+// The listening end. Unlinks the socket again when destroyed.
+class Server {
+  fs::path path;
+  int listenFd{-1};
+
+public:
+  explicit Server(fs::path path) noexcept;
+  ~Server() noexcept;
+  Server(const Server &) = delete;
+  Server &operator=(const Server &) = delete;
+
+  // Binds and listens on the socket, replacing a stale one. Fails if
+  // another instance is already serving it.
+  auto listen() noexcept -> bool;
+  auto fd() const noexcept -> int { return listenFd; }
+  // Accepts one client, if it runs as our user. -1 when there's none.
+  auto accept() const noexcept -> int;
+};
+} // namespace control
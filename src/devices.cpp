@@ -0,0 +1,306 @@
+#include "devices.h"
+#include "wacom.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+using namespace std::string_view_literals;
+
+WacomToolType tool_type_from_string(std::string_view type) noexcept {
+  if (type == "STYLUS"sv) {
+    return WacomToolType::Stylus;
+  } else if (type == "ERASER"sv) {
+    return WacomToolType::Eraser;
+  } else if (type == "CURSOR"sv) {
+    return WacomToolType::Cursor;
+  } else if (type == "TOUCH"sv) {
+    return WacomToolType::Touch;
+  } else if (type == "PAD"sv) {
+    return WacomToolType::Pad;
+  }
+  return WacomToolType::Unknown;
+}
+
+std::string_view to_string(WacomToolType type) noexcept {
+  switch (type) {
+  case WacomToolType::Stylus:
+    return "stylus";
+  case WacomToolType::Eraser:
+    return "eraser";
+  case WacomToolType::Cursor:
+    return "cursor";
+  case WacomToolType::Touch:
+    return "touch";
+  case WacomToolType::Pad:
+    return "pad";
+  case WacomToolType::Unknown:
+    break;
+  }
+  return "unknown";
+}
+
+static constexpr bool is_space(char c) noexcept {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static constexpr bool is_digit(char c) noexcept { return c >= '0' && c <= '9'; }
+
+static constexpr std::string_view trim_right(std::string_view str) noexcept {
+  while (!str.empty() && is_space(str.back())) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+static constexpr std::string_view skip_space(std::string_view str) noexcept {
+  while (!str.empty() && is_space(str.front())) {
+    str.remove_prefix(1);
+  }
+  return str;
+}
+
+static constexpr std::string_view
+take_while(std::string_view &str, bool (*predicate)(char)) noexcept {
+  auto i = 0uz;
+  while (i < str.size() && predicate(str[i])) {
+    ++i;
+  }
+  const auto result = str.substr(0, i);
+  str.remove_prefix(i);
+  return result;
+}
+
+static constexpr bool is_word(char c) noexcept {
+  return !is_space(c);
+}
+
+std::optional<DeviceEntry> DeviceListParser::next() noexcept {
+  while (!input.empty()) {
+    const auto newline = input.find('\n');
+    auto line = input.substr(0, newline);
+    input.remove_prefix(newline == std::string_view::npos ? input.size()
+                                                          : newline + 1);
+
+    // the name may contain anything, so anchor on the last "id:"
+    const auto idPos = line.rfind("id:"sv);
+    if (idPos == std::string_view::npos || idPos == 0 ||
+        !is_space(line[idPos - 1])) {
+      continue;
+    }
+    const auto name = trim_right(line.substr(0, idPos));
+    auto rest = skip_space(line.substr(idPos + 3));
+    const auto id = take_while(rest, is_digit);
+    if (name.empty() || id.empty()) {
+      continue;
+    }
+
+    std::string_view type{};
+    rest = skip_space(rest);
+    if (rest.starts_with("type:"sv)) {
+      rest = skip_space(rest.substr(5));
+      type = take_while(rest, is_word);
+    }
+    return DeviceEntry{.name = name, .id = id, .type = type};
+  }
+  return {};
+}
+
+DeviceList::DeviceList(const DeviceList &other) noexcept {
+  *this = other;
+}
+
+DeviceList &DeviceList::operator=(const DeviceList &other) noexcept {
+  if (this != &other) {
+    clear();
+    reserve(other.size(), other.text.size());
+    for (const auto &device : other) {
+      add(device);
+    }
+  }
+  return *this;
+}
+
+std::string_view DeviceList::intern(std::string_view str) noexcept {
+  if (str.empty()) {
+    return {};
+  }
+  // within capacity, so `str` stays put even if it views into `text`
+  const auto at = text.size();
+  text.resize(at + str.size());
+  std::memcpy(text.data() + at, str.data(), str.size());
+  return {text.data() + at, str.size()};
+}
+
+std::vector<char> DeviceList::grow(std::size_t size, bool spare) noexcept {
+  if (text.size() + size <= text.capacity()) {
+    return {};
+  }
+  auto used = size;
+  for (const auto &device : devices) {
+    used += device.deviceName.size() + device.id.size();
+  }
+  std::vector<char> old{};
+  old.reserve(spare ? 2 * used : used);
+  std::swap(text, old);
+  for (auto &device : devices) {
+    device.deviceName = intern(device.deviceName);
+    device.id = intern(device.id);
+  }
+  return old;
+}
+
+void DeviceList::reserve(std::size_t count, std::size_t textSize) noexcept {
+  devices.reserve(count);
+  grow(textSize, false);
+}
+
+void DeviceList::add(const WacomDevice &device) noexcept {
+  // the old buffer stays alive until `device`, which may view into it, is in
+  const auto old = grow(device.deviceName.size() + device.id.size(), true);
+  devices.push_back(WacomDevice{.deviceName = intern(device.deviceName),
+                                .id = intern(device.id),
+                                .type = device.type});
+}
+
+void DeviceList::replace(std::size_t i, const WacomDevice &device) noexcept {
+  const auto old = grow(device.deviceName.size() + device.id.size(), true);
+  devices[i] = WacomDevice{.deviceName = intern(device.deviceName),
+                           .id = intern(device.id),
+                           .type = device.type};
+}
+
+void DeviceList::remove(std::string_view id) noexcept {
+  std::erase_if(devices,
+                [id](const WacomDevice &device) { return device.id == id; });
+}
+
+void DeviceList::clear() noexcept {
+  devices.clear();
+  text.clear();
+}
+
+DeviceList parse_devices(std::string_view input) noexcept {
+  DeviceList result{};
+  // no name or id is longer than its line
+  result.reserve(std::ranges::count(input, '\n') + 1, input.size());
+  DeviceListParser parser{input};
+  while (const auto entry = parser.next()) {
+    result.add(WacomDevice{.deviceName = entry->name,
+                           .id = entry->id,
+                           .type = tool_type_from_string(entry->type)});
+  }
+  return result;
+}
+
+// FNV-1a, which can be fed one piece at a time
+struct Hasher {
+  std::uint64_t hash{0xcbf29ce484222325ull};
+
+  constexpr auto add(char c) noexcept -> void {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+  }
+  constexpr auto add(std::string_view str) noexcept -> void {
+    for (const auto c : str) {
+      add(c);
+    }
+  }
+  constexpr auto add_squashed(std::string_view str) noexcept -> void {
+    for (const auto c : str) {
+      if (!is_space(c)) {
+        add(c);
+      }
+    }
+  }
+};
+
+static constexpr std::uint64_t hash(std::string_view str) noexcept {
+  Hasher h{};
+  h.add(str);
+  return h.hash;
+}
+
+// `name` with whitespace removed equals `parts` concatenated
+static bool squashed_equals(std::string_view name,
+                            std::span<const std::string_view> parts) noexcept {
+  auto n = 0uz;
+  for (const auto part : parts) {
+    for (const auto c : part) {
+      if (is_space(c)) {
+        continue;
+      }
+      while (n < name.size() && is_space(name[n])) {
+        ++n;
+      }
+      if (n == name.size() || name[n] != c) {
+        return false;
+      }
+      ++n;
+    }
+  }
+  while (n < name.size() && is_space(name[n])) {
+    ++n;
+  }
+  return n == name.size();
+}
+
+void DeviceIndex::insert(std::uint64_t hash, std::uint32_t device,
+                         Key key) noexcept {
+  for (auto i = hash & mask;; i = (i + 1) & mask) {
+    if (slots[i].device == Empty) {
+      slots[i] = Slot{.hash = hash, .device = device, .key = key};
+      return;
+    }
+  }
+}
+
+template <typename Matches>
+std::optional<std::uint32_t>
+DeviceIndex::find(std::uint64_t hash, Matches &&matches) const noexcept {
+  if (slots.empty()) {
+    return {};
+  }
+  for (auto i = hash & mask; slots[i].device != Empty; i = (i + 1) & mask) {
+    if (slots[i].hash == hash && matches(slots[i])) {
+      return slots[i].device;
+    }
+  }
+  return {};
+}
+
+void DeviceIndex::rebuild(std::span<const WacomDevice> devices) noexcept {
+  // three keys per device, at most half full
+  const auto capacity = std::bit_ceil(devices.size() * 3 * 2 + 1);
+  slots.assign(capacity, Slot{.hash = 0, .device = Empty, .key = Key::Id});
+  mask = capacity - 1;
+  for (auto i = 0u; i < devices.size(); ++i) {
+    const auto &device = devices[i];
+    insert(hash(device.id), i, Key::Id);
+    insert(hash(device.deviceName), i, Key::Name);
+    Hasher squashed{};
+    squashed.add_squashed(device.deviceName);
+    insert(squashed.hash, i, Key::Squashed);
+  }
+}
+
+std::optional<std::uint32_t>
+DeviceIndex::lookup(std::span<const WacomDevice> devices,
+                    std::string_view key) const noexcept {
+  return find(hash(key), [&](const Slot &slot) {
+    const auto &device = devices[slot.device];
+    return (slot.key == Key::Id && device.id == key) ||
+           (slot.key == Key::Name && device.deviceName == key);
+  });
+}
+
+std::optional<std::uint32_t> DeviceIndex::lookupSquashed(
+    std::span<const WacomDevice> devices,
+    std::span<const std::string_view> parts) const noexcept {
+  Hasher h{};
+  for (const auto part : parts) {
+    h.add_squashed(part);
+  }
+  return find(h.hash, [&](const Slot &slot) {
+    return slot.key == Key::Squashed &&
+           squashed_equals(devices[slot.device].deviceName, parts);
+  });
+}
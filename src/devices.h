@@ -0,0 +1,122 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// The tools a physical tablet shows up as, one X device each
+enum class WacomToolType { Stylus, Eraser, Cursor, Touch, Pad, Unknown };
+
+auto tool_type_from_string(std::string_view type) noexcept -> WacomToolType;
+auto to_string(WacomToolType type) noexcept -> std::string_view;
+
+// A device of a DeviceList, whose buffer the name and id view into. They are
+// good until the list changes, so copy what has to last longer.
+struct WacomDevice {
+  std::string_view deviceName;
+  std::string_view id;
+  WacomToolType type{WacomToolType::Unknown};
+};
+
+// A device list with the names and ids of all devices in one buffer. Adding
+// and replacing devices copies their name and id in; copies of the list get
+// a buffer of their own.
+class DeviceList {
+  std::vector<char> text{};
+  std::vector<WacomDevice> devices{};
+
+  // Copies `str` to the end of `text`, which has to have room for it
+  auto intern(std::string_view str) noexcept -> std::string_view;
+  // Makes room for `size` more bytes of text. If there isn't, moves the text
+  // to a new buffer, leaving out that of replaced and removed devices, with
+  // as much room again when `spare`. Hands back the old buffer, which the
+  // caller may still be reading from.
+  auto grow(std::size_t size, bool spare) noexcept -> std::vector<char>;
+
+public:
+  DeviceList() noexcept = default;
+  DeviceList(const DeviceList &other) noexcept;
+  DeviceList(DeviceList &&other) noexcept = default;
+  auto operator=(const DeviceList &other) noexcept -> DeviceList &;
+  auto operator=(DeviceList &&other) noexcept -> DeviceList & = default;
+
+  // Room for `count` devices whose names and ids are `textSize` long in all
+  auto reserve(std::size_t count, std::size_t textSize) noexcept -> void;
+  auto add(const WacomDevice &device) noexcept -> void;
+  auto replace(std::size_t i, const WacomDevice &device) noexcept -> void;
+  auto remove(std::string_view id) noexcept -> void;
+  auto clear() noexcept -> void;
+
+  auto begin() const noexcept -> const WacomDevice * { return devices.data(); }
+  auto end() const noexcept -> const WacomDevice * {
+    return devices.data() + devices.size();
+  }
+  auto data() const noexcept -> const WacomDevice * { return devices.data(); }
+  auto size() const noexcept -> std::size_t { return devices.size(); }
+  auto empty() const noexcept -> bool { return devices.empty(); }
+  auto operator[](std::size_t i) const noexcept -> const WacomDevice & {
+    return devices[i];
+  }
+};
+
+// One line of `xsetwacom --list devices`, viewing into the parsed text
+struct DeviceEntry {
+  std::string_view name;
+  std::string_view id;
+  std::string_view type;
+};
+
+// Single pass, allocation free parser for `xsetwacom --list devices` output.
+// Lines look like
+//   Wacom Intuos BT M Pen stylus    	id: 12	type: STYLUS
+// and entries are handed out one at a time as views into `input`, which has
+// to outlive them.
+class DeviceListParser {
+  std::string_view input;
+
+public:
+  explicit DeviceListParser(std::string_view input) noexcept : input(input) {}
+  // The next well formed line, or nothing at the end of input
+  auto next() noexcept -> std::optional<DeviceEntry>;
+};
+
+// Every well formed line of `input`, in one buffer no bigger than `input`
+DeviceList parse_devices(std::string_view input) noexcept;
+
+// Open addressing hash index over a device list, keyed by id, by name and by
+// the name with all whitespace removed (which is what you get when the name
+// is passed on the command line without quotes and the words are glued back
+// together). Stores indices into the list it was built from, which must be
+// rebuilt whenever that list changes.
+class DeviceIndex {
+  enum class Key : std::uint8_t { Id, Name, Squashed };
+  struct Slot {
+    std::uint64_t hash;
+    std::uint32_t device;
+    Key key;
+  };
+  static constexpr auto Empty = UINT32_MAX;
+
+  std::vector<Slot> slots{};
+  std::uint64_t mask{0};
+
+  auto insert(std::uint64_t hash, std::uint32_t device, Key key) noexcept
+      -> void;
+  template <typename Matches>
+  auto find(std::uint64_t hash, Matches &&matches) const noexcept
+      -> std::optional<std::uint32_t>;
+
+public:
+  auto rebuild(std::span<const WacomDevice> devices) noexcept -> void;
+  // Index of the device with id or name `key`
+  auto lookup(std::span<const WacomDevice> devices,
+              std::string_view key) const noexcept
+      -> std::optional<std::uint32_t>;
+  // Index of the device whose name, without whitespace, equals `parts`
+  // concatenated.
+  auto lookupSquashed(std::span<const WacomDevice> devices,
+                      std::span<const std::string_view> parts) const noexcept
+      -> std::optional<std::uint32_t>;
+};
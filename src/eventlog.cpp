@@ -0,0 +1,112 @@
+#include "eventlog.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char Magic[4]{'W', 'U', 'E', 'V'};
+static constexpr std::uint32_t Version = 1;
+
+EventLogWriter::EventLogWriter(const fs::path &path) noexcept
+    : fd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) {
+  if (fd == -1) {
+    return;
+  }
+  EventLogHeader header{};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.recordSize = sizeof(EventRecord);
+  if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+EventLogWriter::~EventLogWriter() noexcept {
+  if (fd != -1) {
+    flush();
+    close(fd);
+  }
+}
+
+bool EventLogWriter::flush() noexcept {
+  const auto bytes = count * sizeof(EventRecord);
+  const auto *data = reinterpret_cast<const char *>(pending.data());
+  count = 0;
+  for (std::size_t written = 0; written < bytes;) {
+    const auto result = write(fd, data + written, bytes - written);
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "Writing event log failed: " << strerror(errno)
+                << std::endl;
+      return false;
+    }
+    written += result;
+  }
+  return true;
+}
+
+void EventLogWriter::append(int type, unsigned int button, int x,
+                            int y) noexcept {
+  if (fd == -1) {
+    return;
+  }
+  const auto now = std::chrono::steady_clock::now().time_since_epoch();
+  pending[count++] = EventRecord{
+      .time = std::chrono::duration_cast<std::chrono::nanoseconds>(now)
+                  .count(),
+      .x = x,
+      .y = y,
+      .type = static_cast<std::uint16_t>(type),
+      .button = static_cast<std::uint16_t>(button),
+      .reserved = 0};
+  if (count == pending.size()) {
+    flush();
+  }
+}
+
+EventLog::EventLog(const fs::path &path) noexcept {
+  const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return;
+  }
+  struct stat st{};
+  if (fstat(fd, &st) == -1 ||
+      static_cast<std::size_t>(st.st_size) < sizeof(EventLogHeader)) {
+    close(fd);
+    return;
+  }
+  mappingSize = st.st_size;
+  mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    mapping = nullptr;
+    return;
+  }
+  // read front to back exactly once
+  madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+
+  const auto *header = static_cast<const EventLogHeader *>(mapping);
+  if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 ||
+      header->version != Version ||
+      header->recordSize != sizeof(EventRecord)) {
+    munmap(mapping, mappingSize);
+    mapping = nullptr;
+    return;
+  }
+  events = std::span<const EventRecord>{
+      reinterpret_cast<const EventRecord *>(header + 1),
+      (mappingSize - sizeof(EventLogHeader)) / sizeof(EventRecord)};
+}
+
+EventLog::~EventLog() noexcept {
+  if (mapping != nullptr) {
+    munmap(mapping, mappingSize);
+  }
+}
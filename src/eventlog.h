@@ -0,0 +1,69 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+
+namespace fs = std::filesystem;
+
+// On-disk layout of a pointer event log (`wu --record`): a header, then one
+// fixed-size record per event in the order the selection loop took them.
+// There is no count, a log is only ever appended to; a partial record at the
+// end (a crashed recording) is ignored.
+struct EventLogHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t recordSize;
+  std::uint32_t reserved;
+};
+
+struct EventRecord {
+  // steady clock nanoseconds when the selection loop took the event
+  std::int64_t time;
+  // root window coordinates
+  std::int32_t x, y;
+  // ButtonPress, ButtonRelease or MotionNotify, and the button for the first
+  // two
+  std::uint16_t type;
+  std::uint16_t button;
+  std::uint32_t reserved;
+};
+static_assert(sizeof(EventRecord) == 24);
+
+// Appends records to a new log, in batches
+class EventLogWriter {
+  int fd{-1};
+  std::array<EventRecord, 256> pending{};
+  std::size_t count{0};
+
+  auto flush() noexcept -> bool;
+
+public:
+  // Truncates `path`; check isOpen
+  explicit EventLogWriter(const fs::path &path) noexcept;
+  ~EventLogWriter() noexcept;
+  EventLogWriter(const EventLogWriter &) = delete;
+  EventLogWriter &operator=(const EventLogWriter &) = delete;
+
+  auto isOpen() const noexcept -> bool { return fd != -1; }
+  auto append(int type, unsigned int button, int x, int y) noexcept -> void;
+};
+
+// Read-only view of a log, mmap'd for as long as it lives
+class EventLog {
+  void *mapping{nullptr};
+  std::size_t mappingSize{0};
+  std::span<const EventRecord> events{};
+
+public:
+  explicit EventLog(const fs::path &path) noexcept;
+  ~EventLog() noexcept;
+  EventLog(const EventLog &) = delete;
+  EventLog &operator=(const EventLog &) = delete;
+
+  // False if the file is missing or isn't an event log
+  auto isOpen() const noexcept -> bool { return mapping != nullptr; }
+  auto records() const noexcept -> std::span<const EventRecord> {
+    return events;
+  }
+};
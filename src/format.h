@@ -0,0 +1,222 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Allocation free formatting into fixed, caller owned storage:
+//
+//   const auto geometry = wu::format<32>("{}x{}+{}+{}", w, h, x, y);
+//   std::cout << geometry.view();
+//
+// The format string is parsed at compile time. Every "{}" takes the next
+// argument, and the number of arguments, their types and, for arguments of
+// bounded width, whether the result fits in the capacity are all checked
+// while compiling. Literal braces aren't supported.
+namespace wu {
+
+// How to write a T. Specializations provide `MaxSize` (0 for unbounded) and
+// `write`, which returns the end of what it wrote or nullptr if it didn't
+// fit between `out` and `end`.
+template <typename T> struct TypeFmtMapper {
+  static constexpr bool Supported = false;
+  static constexpr std::size_t MaxSize = 0;
+};
+
+template <std::integral T>
+  requires(!std::same_as<T, bool> && !std::same_as<T, char>)
+struct TypeFmtMapper<T> {
+  static constexpr bool Supported = true;
+  // digits, plus a sign
+  static constexpr std::size_t MaxSize =
+      std::numeric_limits<T>::digits10 + 2;
+  static constexpr auto write(char *out, char *end, T value) noexcept
+      -> char * {
+    const auto result = std::to_chars(out, end, value);
+    return result.ec == std::errc() ? result.ptr : nullptr;
+  }
+};
+
+template <> struct TypeFmtMapper<char> {
+  static constexpr bool Supported = true;
+  static constexpr std::size_t MaxSize = 1;
+  static constexpr auto write(char *out, char *end, char value) noexcept
+      -> char * {
+    if (out == end) {
+      return nullptr;
+    }
+    *out = value;
+    return out + 1;
+  }
+};
+
+template <> struct TypeFmtMapper<std::string_view> {
+  static constexpr bool Supported = true;
+  static constexpr std::size_t MaxSize = 0;
+  static constexpr auto write(char *out, char *end,
+                              std::string_view value) noexcept -> char * {
+    if (static_cast<std::size_t>(end - out) < value.size()) {
+      return nullptr;
+    }
+    return std::copy(value.begin(), value.end(), out);
+  }
+};
+
+template <>
+struct TypeFmtMapper<std::string> : TypeFmtMapper<std::string_view> {};
+template <>
+struct TypeFmtMapper<const char *> : TypeFmtMapper<std::string_view> {};
+template <> struct TypeFmtMapper<char *> : TypeFmtMapper<std::string_view> {};
+
+template <typename T>
+using FmtMapperOf = TypeFmtMapper<std::decay_t<T>>;
+
+namespace detail {
+// Not constexpr on purpose: reaching it while parsing a format string at
+// compile time is what makes the error show up.
+inline void format_error(const char *) noexcept {}
+} // namespace detail
+
+// A format string for `Args`, parsed and checked at compile time for a
+// result of at most `Capacity` bytes.
+template <std::size_t Capacity, typename... Args> class FormatString {
+  static_assert((FmtMapperOf<Args>::Supported && ...),
+                "wu::format: no TypeFmtMapper for an argument type");
+
+  static constexpr auto ArgCount = sizeof...(Args);
+  static constexpr auto Bounded = ((FmtMapperOf<Args>::MaxSize != 0) && ...);
+  static constexpr auto MaxArgSize = (std::size_t{0} + ... +
+                                      FmtMapperOf<Args>::MaxSize);
+
+public:
+  // Literal text before each argument, and after the last one
+  std::array<std::string_view, ArgCount + 1> literals{};
+
+  template <std::size_t N>
+  consteval FormatString(const char (&str)[N]) noexcept {
+    const auto format = std::string_view{str, N - 1};
+    auto literalSize = 0uz;
+    auto arg = 0uz;
+    auto start = 0uz;
+    for (auto i = 0uz; i < format.size(); ++i) {
+      if (format[i] == '}') {
+        detail::format_error("wu::format: unmatched '}'");
+      }
+      if (format[i] != '{') {
+        continue;
+      }
+      if (i + 1 >= format.size() || format[i + 1] != '}') {
+        detail::format_error("wu::format: only \"{}\" is supported");
+      }
+      if (arg == ArgCount) {
+        detail::format_error("wu::format: more {} than arguments");
+        return;
+      }
+      literals[arg++] = format.substr(start, i - start);
+      literalSize += i - start;
+      start = i + 2;
+      ++i;
+    }
+    if (arg != ArgCount) {
+      detail::format_error("wu::format: fewer {} than arguments");
+    }
+    literals[ArgCount] = format.substr(start);
+    literalSize += format.size() - start;
+    if (Bounded && literalSize + MaxArgSize > Capacity) {
+      detail::format_error("wu::format: capacity too small for the result");
+    }
+  }
+};
+
+namespace detail {
+struct Written {
+  char *end;
+  // whether all of it fit
+  bool complete;
+};
+
+template <std::size_t Capacity, typename... Args>
+constexpr auto format_into(char *out, char *end,
+                           const FormatString<Capacity, Args...> &fmt,
+                           const Args &...args) noexcept -> Written {
+  auto arg = 0uz;
+  const auto put = [&](auto write) noexcept {
+    auto *next = write(out);
+    if (next == nullptr) {
+      return false;
+    }
+    out = next;
+    return true;
+  };
+  const auto literal = [&](std::string_view text) noexcept {
+    return [text, end](char *at) noexcept {
+      return TypeFmtMapper<std::string_view>::write(at, end, text);
+    };
+  };
+  const auto complete =
+      ((put(literal(fmt.literals[arg++])) &&
+        put([&args, end](char *at) noexcept {
+          return FmtMapperOf<Args>::write(at, end, args);
+        })) &&
+       ...) &&
+      put(literal(fmt.literals[arg]));
+  return Written{out, complete};
+}
+} // namespace detail
+
+// Formats into `out` and returns what was written. `Capacity` is what the
+// format is checked against at compile time. Stops at the first piece that
+// doesn't fit `out`, without writing part of it.
+template <std::size_t Capacity, typename... Args>
+constexpr auto
+format_to(std::span<char> out,
+          FormatString<Capacity, std::type_identity_t<Args>...> fmt,
+          const Args &...args) noexcept -> std::string_view {
+  const auto written = detail::format_into<Capacity, Args...>(
+      out.data(), out.data() + out.size(), fmt, args...);
+  return std::string_view{out.data(), written.end};
+}
+
+// Formatted text held in place, NUL terminated
+template <std::size_t Capacity> class FixedString {
+  std::array<char, Capacity + 1> buffer{};
+  std::size_t length{0};
+  bool cut{false};
+
+public:
+  template <typename... Args>
+  constexpr FixedString(const FormatString<Capacity, Args...> &fmt,
+                        const Args &...args) noexcept {
+    const auto written = detail::format_into<Capacity, Args...>(
+        buffer.data(), buffer.data() + Capacity, fmt, args...);
+    length = static_cast<std::size_t>(written.end - buffer.data());
+    buffer[length] = '\0';
+    cut = !written.complete;
+  }
+
+  constexpr auto view() const noexcept -> std::string_view {
+    return std::string_view{buffer.data(), length};
+  }
+  constexpr auto c_str() const noexcept -> const char * {
+    return buffer.data();
+  }
+  constexpr auto size() const noexcept -> std::size_t { return length; }
+  // Whether an unbounded argument didn't fit and the text was cut short
+  constexpr auto truncated() const noexcept -> bool { return cut; }
+  auto str() const -> std::string { return std::string{view()}; }
+};
+
+// Formats into a FixedString of `Capacity` bytes on the stack
+template <std::size_t Capacity, typename... Args>
+constexpr auto
+format(FormatString<Capacity, std::type_identity_t<Args>...> fmt,
+       const Args &...args) noexcept -> FixedString<Capacity> {
+  return FixedString<Capacity>{fmt, args...};
+}
+} // namespace wu
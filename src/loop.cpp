@@ -0,0 +1,99 @@
+#include "loop.h"
+#include "util.h"
+#include <algorithm>
+#include <cerrno>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+EventLoop::Readable::Readable(EventLoop &loop,
+                              std::initializer_list<int> list) noexcept
+    : loop(loop) {
+  std::copy_n(list.begin(), std::min(list.size(), MaxFds), fds.begin());
+}
+
+void EventLoop::Readable::await_suspend(
+    std::coroutine_handle<> handle) noexcept {
+  waiter = handle;
+  for (const auto fd : fds) {
+    if (fd >= 0) {
+      loop.add(fd, this);
+    }
+  }
+}
+
+void EventLoop::Readable::ready(int fd) noexcept {
+  for (const auto registered : fds) {
+    if (registered >= 0) {
+      loop.remove(registered);
+    }
+  }
+  readyFd = fd;
+  waiter.resume();
+}
+
+EventLoop::EventLoop() noexcept : epollFd(epoll_create1(EPOLL_CLOEXEC)) {
+  if (epollFd == -1) {
+    FATAL("epoll_create1 failed");
+  }
+}
+
+EventLoop::~EventLoop() noexcept { close(epollFd); }
+
+void EventLoop::add(int fd, Registration *registration) noexcept {
+  epoll_event event{.events = EPOLLIN, .data = {.fd = fd}};
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+    FATAL("epoll_ctl add failed");
+  }
+  if (registrations.size() <= static_cast<std::size_t>(fd)) {
+    registrations.resize(fd + 1, nullptr);
+  }
+  registrations[fd] = registration;
+}
+
+void EventLoop::remove(int fd) noexcept {
+  epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+  registrations[fd] = nullptr;
+}
+
+void EventLoop::watch(int fd, std::function<void()> handler) noexcept {
+  auto &watch =
+      watches.emplace_back(std::make_unique<Watch>(fd, std::move(handler)));
+  add(fd, watch.get());
+}
+
+void EventLoop::unwatch(int fd) noexcept {
+  remove(fd);
+  for (auto &watch : watches) {
+    if (watch->fd == fd) {
+      retired.push_back(std::move(watch));
+    }
+  }
+  std::erase(watches, nullptr);
+}
+
+void EventLoop::spawn(Task<void> task) noexcept {
+  task.start();
+  if (!task.done()) {
+    tasks.push_back(std::move(task));
+  }
+}
+
+void EventLoop::run() noexcept {
+  while (!tasks.empty()) {
+    // One event at a time: resuming a coroutine can unregister the fds of
+    // the other events in a batch, and re-use them for something else.
+    epoll_event event;
+    const auto count = epoll_wait(epollFd, &event, 1, -1);
+    if (count == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      FATAL("epoll_wait failed");
+    }
+    if (count == 1 && registrations[event.data.fd] != nullptr) {
+      registrations[event.data.fd]->ready(event.data.fd);
+    }
+    std::erase_if(tasks, [](const Task<void> &task) { return task.done(); });
+    retired.clear();
+  }
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "task.h"
+#include <array>
+#include <coroutine>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+// Single threaded epoll scheduler. Coroutines suspend on `readable` until one
+// of their file descriptors has something to read; fds with a `watch` get
+// their handler called whenever they're readable in between, which is how X
+// events keep being serviced while commands are in flight.
+class EventLoop {
+public:
+  // Whoever is interested in an fd
+  struct Registration {
+    virtual auto ready(int fd) noexcept -> void = 0;
+
+  protected:
+    ~Registration() = default;
+  };
+
+  // Awaiter for the first of up to MaxFds descriptors to become readable;
+  // resumes with that descriptor. Negative descriptors are ignored.
+  class Readable final : Registration {
+    static constexpr auto MaxFds = 3uz;
+    EventLoop &loop;
+    std::array<int, MaxFds> fds{-1, -1, -1};
+    int readyFd{-1};
+    std::coroutine_handle<> waiter{};
+
+    auto ready(int fd) noexcept -> void override;
+
+  public:
+    Readable(EventLoop &loop, std::initializer_list<int> fds) noexcept;
+    auto await_ready() const noexcept -> bool { return false; }
+    auto await_suspend(std::coroutine_handle<> handle) noexcept -> void;
+    auto await_resume() const noexcept -> int { return readyFd; }
+  };
+
+private:
+  struct Watch final : Registration {
+    int fd;
+    std::function<void()> handler;
+
+    Watch(int fd, std::function<void()> handler) noexcept
+        : fd(fd), handler(std::move(handler)) {}
+    auto ready(int) noexcept -> void override { handler(); }
+  };
+
+  int epollFd{-1};
+  // indexed by fd; fds are small and dense
+  std::vector<Registration *> registrations{};
+  std::vector<Task<void>> tasks{};
+  // heap allocated, `registrations` holds on to their addresses
+  std::vector<std::unique_ptr<Watch>> watches{};
+  // unwatched while their handler may still be running; freed by run()
+  std::vector<std::unique_ptr<Watch>> retired{};
+
+  auto add(int fd, Registration *registration) noexcept -> void;
+  auto remove(int fd) noexcept -> void;
+
+public:
+  EventLoop() noexcept;
+  ~EventLoop() noexcept;
+  EventLoop(const EventLoop &) = delete;
+  EventLoop &operator=(const EventLoop &) = delete;
+
+  auto readable(std::initializer_list<int> fds) noexcept -> Readable {
+    return Readable{*this, fds};
+  }
+  // Calls `handler` whenever `fd` is readable while the loop runs. The
+  // handler may unwatch its own fd (at end of file, say).
+  auto watch(int fd, std::function<void()> handler) noexcept -> void;
+  auto unwatch(int fd) noexcept -> void;
+  // Starts `task`; it runs up to its first suspension right away
+  auto spawn(Task<void> task) noexcept -> void;
+  // Dispatches events until every spawned task has finished
+  auto run() noexcept -> void;
+};
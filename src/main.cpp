@@ -7,24 +7,15 @@
 #include <iostream>
 
 int main(int argc, const char **argv) {
-  ApplicationState::Initialize(argc, argv);
-  if (!ApplicationState::verifyHasXSetWacom()) {
-    std::cerr << "could not find xsetwacom on $PATH" << std::endl;
+  // A running server already has X and the device list at hand
+  if (const auto exitCode = ApplicationState::forward(argc, argv); exitCode) {
+    return exitCode.value();
   }
-  auto &app = ApplicationState::getAppInstance();
 
-  auto config = parse_config(app.args());
-  if (config) {
-    const auto select = app.selectScreenArea();
-    app.configureWacomMapping(config.value(), select);
-  } else {
-    auto config = app.selectDevice();
-    if (!config) {
-      std::cout << " you picked an invalid option\n";
-    }
-    const auto select = app.selectScreenArea();
-    app.configureWacomMapping(WacomConfig{.deviceName = std::move(config->id)},
-                              select);
-  }
-  return 0;
+  ApplicationState::Initialize(argc, argv);
+  auto &app = ApplicationState::getAppInstance();
+  const auto exitCode = app.run();
+  app.writeTrace();
+  ApplicationState::Shutdown();
+  return exitCode;
 }
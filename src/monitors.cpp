@@ -0,0 +1,183 @@
+#include "monitors.h"
+#include <X11/extensions/Xrandr.h>
+#include <algorithm>
+#include <cstdlib>
+
+void MonitorLayout::init(const X11Connection &x11) noexcept {
+  int errorBase;
+  if (!XRRQueryExtension(x11.display, &eventBase, &errorBase)) {
+    eventBase = -1;
+    return;
+  }
+  XRRSelectInput(x11.display, x11.root,
+                 RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask |
+                     RROutputChangeNotifyMask);
+}
+
+static std::chrono::nanoseconds refresh_interval(const XRRScreenResources &res,
+                                                 RRMode mode) noexcept {
+  for (auto i = 0; i < res.nmode; ++i) {
+    const auto &info = res.modes[i];
+    if (info.id == mode && info.hTotal != 0 && info.vTotal != 0 &&
+        info.dotClock != 0) {
+      const auto hz = static_cast<double>(info.dotClock) /
+                      (static_cast<double>(info.hTotal) * info.vTotal);
+      return std::chrono::nanoseconds{static_cast<long>(1e9 / hz)};
+    }
+  }
+  return std::chrono::nanoseconds{0};
+}
+
+void MonitorLayout::query(const X11Connection &x11) noexcept {
+  monitors.clear();
+  xEdges.clear();
+  yEdges.clear();
+  valid = true;
+  if (eventBase == -1) {
+    return;
+  }
+  auto *res = XRRGetScreenResourcesCurrent(x11.display, x11.root);
+  if (res == nullptr) {
+    return;
+  }
+  for (auto i = 0; i < res->noutput; ++i) {
+    auto *output = XRRGetOutputInfo(x11.display, res, res->outputs[i]);
+    if (output == nullptr) {
+      continue;
+    }
+    if (output->connection == RR_Connected && output->crtc != None) {
+      if (auto *crtc = XRRGetCrtcInfo(x11.display, res, output->crtc); crtc) {
+        monitors.push_back(Monitor{
+            .name = std::string{output->name,
+                                static_cast<std::size_t>(output->nameLen)},
+            .crtc = output->crtc,
+            .mode = crtc->mode,
+            .geometry = Selection{.dimensions = {static_cast<int>(crtc->width),
+                                                 static_cast<int>(crtc->height)},
+                                  .origin = {crtc->x, crtc->y}},
+            .refreshInterval = refresh_interval(*res, crtc->mode)});
+        XRRFreeCrtcInfo(crtc);
+      }
+    }
+    XRRFreeOutputInfo(output);
+  }
+  XRRFreeScreenResources(res);
+  updateEdges();
+}
+
+void MonitorLayout::updateEdges() noexcept {
+  xEdges.clear();
+  yEdges.clear();
+  for (const auto &[name, crtc, mode, geometry, refresh] : monitors) {
+    xEdges.push_back(geometry.origin.x);
+    xEdges.push_back(geometry.origin.x + geometry.dimensions.x);
+    yEdges.push_back(geometry.origin.y);
+    yEdges.push_back(geometry.origin.y + geometry.dimensions.y);
+  }
+}
+
+std::span<const Monitor>
+MonitorLayout::get(const X11Connection &x11) noexcept {
+  if (!valid) {
+    query(x11);
+  }
+  return monitors;
+}
+
+const Monitor *MonitorLayout::find(const X11Connection &x11,
+                                   std::string_view name) noexcept {
+  const auto all = get(x11);
+  const auto it = std::ranges::find(all, name, &Monitor::name);
+  return it == all.end() ? nullptr : &*it;
+}
+
+std::optional<std::chrono::nanoseconds>
+MonitorLayout::frameInterval(const X11Connection &x11) noexcept {
+  std::optional<std::chrono::nanoseconds> result{};
+  for (const auto &monitor : get(x11)) {
+    if (monitor.refreshInterval.count() > 0 &&
+        (!result || monitor.refreshInterval < result.value())) {
+      result = monitor.refreshInterval;
+    }
+  }
+  return result;
+}
+
+// Moves `edge` onto the closest of the monitor edges in `candidates` that is
+// within `distance`.
+static int snap_edge(int edge, std::span<const int> candidates,
+                     int distance) noexcept {
+  auto best = edge;
+  auto bestDistance = distance + 1;
+  for (const auto candidate : candidates) {
+    const auto d = std::abs(candidate - edge);
+    if (d < bestDistance) {
+      best = candidate;
+      bestDistance = d;
+    }
+  }
+  return best;
+}
+
+Selection MonitorLayout::snap(const X11Connection &x11,
+                              Selection selection) noexcept {
+  // a layout change may have dropped the cache mid selection
+  if (get(x11).empty()) {
+    return selection;
+  }
+  const auto left = snap_edge(selection.origin.x, xEdges, SnapDistance);
+  const auto top = snap_edge(selection.origin.y, yEdges, SnapDistance);
+  const auto right = snap_edge(selection.origin.x + selection.dimensions.x,
+                               xEdges, SnapDistance);
+  const auto bottom = snap_edge(selection.origin.y + selection.dimensions.y,
+                                yEdges, SnapDistance);
+  return Selection{.dimensions = {std::max(right - left, 0),
+                                  std::max(bottom - top, 0)},
+                   .origin = {left, top}};
+}
+
+bool MonitorLayout::isEvent(const XEvent &event) const noexcept {
+  return eventBase != -1 && (event.type == eventBase + RRScreenChangeNotify ||
+                             event.type == eventBase + RRNotify);
+}
+
+bool MonitorLayout::handleEvent(XEvent &event) noexcept {
+  if (eventBase == -1) {
+    return false;
+  }
+  if (event.type == eventBase + RRScreenChangeNotify) {
+    // keeps DisplayWidth/DisplayHeight in sync with the new screen size
+    XRRUpdateConfiguration(&event);
+    return true;
+  }
+  if (event.type != eventBase + RRNotify) {
+    return false;
+  }
+  const auto &notify = reinterpret_cast<const XRRNotifyEvent &>(event);
+  if (notify.subtype == RRNotify_CrtcChange && valid) {
+    const auto &change = reinterpret_cast<const XRRCrtcChangeNotifyEvent &>(event);
+    const auto it = std::ranges::find(monitors, change.crtc, &Monitor::crtc);
+    if (it != monitors.end()) {
+      if (change.mode == None) {
+        monitors.erase(it);
+        updateEdges();
+      } else if (change.mode != it->mode) {
+        // new refresh rate, which we'd need the mode list for
+        valid = false;
+      } else {
+        it->geometry =
+            Selection{.dimensions = {static_cast<int>(change.width),
+                                     static_cast<int>(change.height)},
+                      .origin = {change.x, change.y}};
+        updateEdges();
+      }
+    } else if (change.mode != None) {
+      // a CRTC we didn't know about lit up; its output name is only known
+      // from a full query
+      valid = false;
+    }
+  } else if (notify.subtype == RRNotify_OutputChange) {
+    valid = false;
+  }
+  return true;
+}
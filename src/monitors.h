@@ -0,0 +1,54 @@
+#pragma once
+#include "selection.h"
+#include "x11.h"
+#include <chrono>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct Monitor {
+  // RandR output name, e.g. "DP-2"
+  std::string name;
+  XID crtc;
+  XID mode;
+  Selection geometry;
+  std::chrono::nanoseconds refreshInterval;
+};
+
+// The RandR monitor layout, queried once and then kept up to date from RandR
+// events: CRTC changes patch the cached geometry in place, output changes
+// (connect, disconnect) drop the cache so it's re-queried on next use.
+class MonitorLayout {
+  std::vector<Monitor> monitors{};
+  // Left and right, top and bottom edges of `monitors`, for snap
+  std::vector<int> xEdges{};
+  std::vector<int> yEdges{};
+  bool valid{false};
+  // -1 when the server has no RandR
+  int eventBase{-1};
+
+  auto query(const X11Connection &x11) noexcept -> void;
+  auto updateEdges() noexcept -> void;
+
+public:
+  // How close (in pixels) a selection edge has to get to a monitor edge
+  // before it snaps to it
+  static constexpr int SnapDistance = 16;
+
+  auto init(const X11Connection &x11) noexcept -> void;
+  auto get(const X11Connection &x11) noexcept -> std::span<const Monitor>;
+  auto find(const X11Connection &x11, std::string_view name) noexcept
+      -> const Monitor *;
+  // Refresh interval of the fastest monitor, if any is known
+  auto frameInterval(const X11Connection &x11) noexcept
+      -> std::optional<std::chrono::nanoseconds>;
+  // `selection` with every edge that is within SnapDistance of a monitor
+  // edge moved onto it
+  auto snap(const X11Connection &x11, Selection selection) noexcept
+      -> Selection;
+  auto isEvent(const XEvent &event) const noexcept -> bool;
+  // Returns true if `event` was a RandR event
+  auto handleEvent(XEvent &event) noexcept -> bool;
+};
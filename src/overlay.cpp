@@ -0,0 +1,159 @@
+#include "overlay.h"
+#include <algorithm>
+#include <string>
+
+// premultiplied ARGB
+static constexpr unsigned long OutlineColor = 0xff2a82da;
+
+static bool operator==(const XRectangle &a, const XRectangle &b) noexcept {
+  return a.x == b.x && a.y == b.y && a.width == b.width &&
+         a.height == b.height;
+}
+
+static bool intersects(const XRectangle &a, const XRectangle &b) noexcept {
+  return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height &&
+         b.y < a.y + a.height;
+}
+
+static XRectangle rect(int x, int y, int width, int height) noexcept {
+  return XRectangle{.x = static_cast<short>(x),
+                    .y = static_cast<short>(y),
+                    .width = static_cast<unsigned short>(std::max(width, 0)),
+                    .height = static_cast<unsigned short>(std::max(height, 0))};
+}
+
+std::array<XRectangle, 4> outline(Selection selection,
+                                  int thickness) noexcept {
+  const auto [width, height] = selection.dimensions;
+  const auto [x, y] = selection.origin;
+  const auto t = std::min({thickness, width, height});
+  const auto inner = std::max(height - 2 * t, 0);
+  return {rect(x, y, width, t), rect(x, y + height - t, width, t),
+          rect(x, y + t, t, inner), rect(x + width - t, y + t, t, inner)};
+}
+
+SelectionOverlay::SelectionOverlay(const X11Connection &x11) noexcept
+    : x11(x11) {
+  if (!createArgbWindow()) {
+    createXorGc();
+  }
+}
+
+SelectionOverlay::~SelectionOverlay() noexcept {
+  clear();
+  if (gc != nullptr) {
+    XFreeGC(x11.display, gc);
+  }
+  if (window != None) {
+    XDestroyWindow(x11.display, window);
+  }
+  if (colormap != None) {
+    XFreeColormap(x11.display, colormap);
+  }
+  XFlush(x11.display);
+}
+
+bool SelectionOverlay::createArgbWindow() noexcept {
+  // Transparent windows only look transparent when a compositor is running
+  const auto cm = "_NET_WM_CM_S" + std::to_string(x11.screen);
+  const auto cmAtom = XInternAtom(x11.display, cm.c_str(), False);
+  if (XGetSelectionOwner(x11.display, cmAtom) == None) {
+    return false;
+  }
+  XVisualInfo visual;
+  if (!XMatchVisualInfo(x11.display, x11.screen, 32, TrueColor, &visual)) {
+    return false;
+  }
+
+  const auto [width, height] = x11.screenSize();
+  colormap =
+      XCreateColormap(x11.display, x11.root, visual.visual, AllocNone);
+  XSetWindowAttributes attributes{};
+  attributes.override_redirect = True;
+  attributes.colormap = colormap;
+  attributes.background_pixel = 0;
+  attributes.border_pixel = 0;
+  window = XCreateWindow(
+      x11.display, x11.root, 0, 0, width, height, 0, visual.depth,
+      InputOutput, visual.visual,
+      CWOverrideRedirect | CWColormap | CWBackPixel | CWBorderPixel,
+      &attributes);
+  XMapRaised(x11.display, window);
+
+  XGCValues values{};
+  values.foreground = OutlineColor;
+  gc = XCreateGC(x11.display, window, GCForeground, &values);
+  return true;
+}
+
+void SelectionOverlay::createXorGc() noexcept {
+  xorMode = true;
+  XGCValues values{};
+  values.function = GXxor;
+  values.foreground = WhitePixel(x11.display, x11.screen) ^
+                      BlackPixel(x11.display, x11.screen);
+  values.subwindow_mode = IncludeInferiors;
+  gc = XCreateGC(x11.display, x11.root,
+                 GCFunction | GCForeground | GCSubwindowMode, &values);
+}
+
+void SelectionOverlay::update(Selection current) noexcept {
+  const auto next = outline(current, Thickness);
+  const auto drawable = xorMode ? x11.root : window;
+  std::array<XRectangle, 8> changed{};
+  auto count = 0;
+
+  if (drawn) {
+    for (const auto &old : drawn.value()) {
+      if (std::ranges::find(next, old) != next.end()) {
+        continue;
+      }
+      if (xorMode) {
+        // XOR-ing it again erases it
+        changed[count++] = old;
+      } else {
+        XClearArea(x11.display, window, old.x, old.y, old.width, old.height,
+                   False);
+      }
+    }
+  }
+
+  for (const auto &edge : next) {
+    const auto unchanged =
+        drawn && std::ranges::find(drawn.value(), edge) != drawn->end();
+    // An unchanged edge only needs drawing if clearing an old edge that
+    // overlapped it wiped some of it out.
+    const auto damaged =
+        !xorMode && unchanged &&
+        std::ranges::any_of(drawn.value(), [&](const XRectangle &old) {
+          return std::ranges::find(next, old) == next.end() &&
+                 intersects(old, edge);
+        });
+    if ((!unchanged || damaged) && edge.width > 0 && edge.height > 0) {
+      changed[count++] = edge;
+    }
+  }
+
+  if (count > 0) {
+    XFillRectangles(x11.display, drawable, gc, changed.data(), count);
+  }
+  drawn = next;
+  XFlush(x11.display);
+}
+
+void SelectionOverlay::clear() noexcept {
+  if (!drawn) {
+    return;
+  }
+  if (xorMode) {
+    XFillRectangles(x11.display, x11.root, gc, drawn->data(),
+                    static_cast<int>(drawn->size()));
+  } else {
+    for (const auto &edge : drawn.value()) {
+      XClearArea(x11.display, window, edge.x, edge.y, edge.width, edge.height,
+                 False);
+    }
+  }
+  drawn.reset();
+  XFlush(x11.display);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include "selection.h"
+#include "x11.h"
+#include <X11/Xutil.h>
+#include <array>
+#include <optional>
+
+// Draws the outline of the area being selected. On a composited desktop the
+// outline lives on a transparent override-redirect ARGB window; without a
+// compositor it is XOR-ed straight onto the root window. Either way only the
+// edges that moved since the last update are touched, so a drag costs a few
+// thin rectangles per frame no matter how large the screen is.
+class SelectionOverlay {
+  const X11Connection &x11;
+  Window window{None};
+  Colormap colormap{None};
+  GC gc{nullptr};
+  bool xorMode{false};
+  std::optional<std::array<XRectangle, 4>> drawn{};
+
+  auto createArgbWindow() noexcept -> bool;
+  auto createXorGc() noexcept -> void;
+
+public:
+  static constexpr int Thickness = 2;
+
+  explicit SelectionOverlay(const X11Connection &x11) noexcept;
+  ~SelectionOverlay() noexcept;
+  SelectionOverlay(const SelectionOverlay &) = delete;
+  SelectionOverlay &operator=(const SelectionOverlay &) = delete;
+
+  auto update(Selection current) noexcept -> void;
+  auto clear() noexcept -> void;
+};
+
+// The outline of `selection` as four non-overlapping strips: top, bottom,
+// left, right. Not overlapping matters when XOR-ing.
+auto outline(Selection selection, int thickness) noexcept
+    -> std::array<XRectangle, 4>;
@@ -0,0 +1,55 @@
+#include "pacer.h"
+#include "util.h"
+#include <cstdint>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+static itimerspec one_shot(std::chrono::nanoseconds delay) noexcept {
+  // an all-zero it_value disarms the timer, so never go below 1ns
+  const auto ns = std::max<std::int64_t>(delay.count(), 1);
+  return itimerspec{.it_interval = {0, 0},
+                    .it_value = {.tv_sec = ns / 1'000'000'000,
+                                 .tv_nsec = ns % 1'000'000'000}};
+}
+
+FramePacer::FramePacer(std::chrono::nanoseconds interval) noexcept
+    : timer(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)),
+      interval(interval) {
+  if (timer == -1) {
+    FATAL("timerfd_create failed");
+  }
+}
+
+FramePacer::~FramePacer() noexcept { close(timer); }
+
+void FramePacer::schedule() noexcept {
+  if (armed) {
+    return;
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - last;
+  restart(elapsed >= interval ? std::chrono::nanoseconds{0}
+                              : interval - elapsed);
+}
+
+void FramePacer::restart(std::chrono::nanoseconds delay) noexcept {
+  const auto spec = one_shot(delay);
+  timerfd_settime(timer, 0, &spec, nullptr);
+  armed = true;
+}
+
+void FramePacer::cancel() noexcept {
+  const itimerspec disarm{};
+  timerfd_settime(timer, 0, &disarm, nullptr);
+  armed = false;
+}
+
+bool FramePacer::consume() noexcept {
+  std::uint64_t expirations = 0;
+  if (::read(timer, &expirations, sizeof(expirations)) !=
+      sizeof(expirations)) {
+    return false;
+  }
+  armed = false;
+  last = std::chrono::steady_clock::now();
+  return true;
+}
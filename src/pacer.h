@@ -0,0 +1,38 @@
+#pragma once
+#include <chrono>
+
+// One-shot timerfd that fires at most once per `interval`, for work that
+// should happen no more often than the display refreshes (or any other rate
+// limit). Put fd() in a poll set; when it's readable, call consume() and do
+// the work.
+class FramePacer {
+  int timer{-1};
+  bool armed{false};
+  std::chrono::nanoseconds interval;
+  std::chrono::steady_clock::time_point last{};
+
+public:
+  explicit FramePacer(std::chrono::nanoseconds interval) noexcept;
+  ~FramePacer() noexcept;
+  FramePacer(const FramePacer &) = delete;
+  FramePacer &operator=(const FramePacer &) = delete;
+
+  auto fd() const noexcept -> int { return timer; }
+  auto isArmed() const noexcept -> bool { return armed; }
+  auto setInterval(std::chrono::nanoseconds next) noexcept -> void {
+    interval = next;
+  }
+  // Arms the timer for the next frame boundary, i.e. `interval` after the
+  // last time it fired, or right away if that's already in the past. Does
+  // nothing if the timer is already armed.
+  auto schedule() noexcept -> void;
+  // Arms the timer `delay` from now, pushing back a pending expiry (debounce)
+  auto restart(std::chrono::nanoseconds delay) noexcept -> void;
+  auto cancel() noexcept -> void;
+  // Reads the expiration, marks the frame as started. Returns false on a
+  // spurious wakeup.
+  auto consume() noexcept -> bool;
+};
+
+// Refresh interval used when the real refresh rate of the display is unknown
+inline constexpr std::chrono::nanoseconds DefaultFrameInterval{16'666'667};
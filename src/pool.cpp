@@ -0,0 +1,72 @@
+#include "pool.h"
+
+ThreadPool::ThreadPool(std::size_t threads) noexcept {
+  workers.reserve(threads);
+  for (auto i = 0uz; i < threads; ++i) {
+    workers.emplace_back([this]() { work(); });
+  }
+}
+
+ThreadPool::~ThreadPool() noexcept { join(); }
+
+void ThreadPool::join() noexcept {
+  {
+    std::lock_guard lock{mutex};
+    stopping = true;
+  }
+  wake.notify_all();
+  // the jthreads join as they go
+  workers.clear();
+}
+
+void ThreadPool::work() noexcept {
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock lock{mutex};
+      wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job();
+  }
+}
+
+void ThreadPool::post(std::function<void()> job) noexcept {
+  {
+    std::lock_guard lock{mutex};
+    jobs.push_back(std::move(job));
+  }
+  wake.notify_one();
+}
+
+void Strand::post(std::function<void()> job) noexcept {
+  {
+    std::lock_guard lock{mutex};
+    jobs.push_back(std::move(job));
+    if (running) {
+      return;
+    }
+    running = true;
+  }
+  pool.post([this]() { drain(); });
+}
+
+void Strand::drain() noexcept {
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::lock_guard lock{mutex};
+      if (jobs.empty()) {
+        running = false;
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job();
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed number of threads taking jobs off one queue. Destroying the pool
+// finishes what was posted before it returns.
+class ThreadPool {
+  std::mutex mutex{};
+  std::condition_variable wake{};
+  std::deque<std::function<void()>> jobs{};
+  bool stopping{false};
+  std::vector<std::jthread> workers{};
+
+  auto work() noexcept -> void;
+
+public:
+  explicit ThreadPool(std::size_t threads) noexcept;
+  ~ThreadPool() noexcept;
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  auto post(std::function<void()> job) noexcept -> void;
+  // Finishes what was posted and stops the threads; nothing posted after
+  // runs
+  auto join() noexcept -> void;
+};
+
+// Runs its jobs on a pool one at a time, in the order they were posted, for
+// state that only one thread may touch at once (an Xlib Display, say).
+class Strand {
+  ThreadPool &pool;
+  std::mutex mutex{};
+  std::deque<std::function<void()>> jobs{};
+  // whether a pool thread is working through `jobs`
+  bool running{false};
+
+  auto drain() noexcept -> void;
+
+public:
+  explicit Strand(ThreadPool &pool) noexcept : pool(pool) {}
+  Strand(const Strand &) = delete;
+  Strand &operator=(const Strand &) = delete;
+
+  auto post(std::function<void()> job) noexcept -> void;
+};
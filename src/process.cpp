@@ -1,102 +1,284 @@
 #include "process.h"
+#include "loop.h"
+#include "trace.h"
 #include "util.h"
+#include <array>
+#include <cerrno>
+#include <csignal>
 #include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
-#include <thread>
 
-ExecResult::~ExecResult() noexcept {
-  if (procStdout != -1) {
-    close(procStdout);
-  }
-}
+extern char **environ;
 
-ExecResult::ExecResult(int out, ExitCode code) noexcept
-    : procStdout(out), code(code) {}
+static constexpr auto ReadChunk = 4096uz;
 
-static void execute(std::string cmd, const char **argv) noexcept {
-  if (execv(cmd.data(),
-            reinterpret_cast<char *const *>(const_cast<char **>(argv))) == -1) {
-    FATAL("failed to execv");
+std::span<char> OutputBuffer::prepare(std::size_t minimum) noexcept {
+  if (bytes.size() - length < minimum) {
+    bytes.resize(std::max(bytes.size() * 2, length + minimum));
   }
+  return std::span<char>{bytes.data() + length, bytes.size() - length};
 }
 
 bool ExecResult::succcess() const noexcept { return code.code == 0; }
 
-int ExecResult::std_out() const noexcept { return procStdout; }
+// Owns the file descriptors of one running child and tears them down no
+// matter how we leave `run`.
+class ProcessRunner {
+  ExecResult &result;
+  pid_t pid{-1};
+  int pidfd{-1};
+  std::array<int, 2> stdoutPipe{-1, -1};
+  std::array<int, 2> stderrPipe{-1, -1};
+  std::chrono::steady_clock::time_point started{};
+  std::uint64_t traceStarted{0};
 
-/*static*/
-std::unique_ptr<ExecResult>
-ExecResult::exec(std::string cmd, std::span<const std::string> args) noexcept {
+  static void close_fd(int &fd) noexcept {
+    if (fd != -1) {
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  // Returns false when the stream has reached EOF (or failed)
+  static bool drain(int fd, OutputBuffer &buffer) noexcept {
+    for (;;) {
+      auto space = buffer.prepare(ReadChunk);
+      const auto bytes = ::read(fd, space.data(), space.size());
+      if (bytes > 0) {
+        buffer.commit(bytes);
+        // a short read means the pipe is empty for now
+        if (static_cast<std::size_t>(bytes) < space.size()) {
+          return true;
+        }
+      } else if (bytes == -1 && errno == EINTR) {
+        continue;
+      } else if (bytes == -1 && errno == EAGAIN) {
+        return true;
+      } else {
+        return false;
+      }
+    }
+  }
+
+  auto reap() noexcept -> void {
+    int exitCode = -1;
+    if (pidfd != -1) {
+      siginfo_t info{};
+      while (waitid(static_cast<idtype_t>(P_PIDFD), pidfd, &info, WEXITED) ==
+             -1) {
+        if (errno != EINTR) {
+          FATAL("waitid on pidfd failed");
+        }
+      }
+      exitCode = info.si_code == CLD_EXITED ? info.si_status
+                                            : 128 + info.si_status;
+    } else {
+      int stat;
+      while (waitpid(pid, &stat, 0) == -1) {
+        if (errno != EINTR) {
+          FATAL("waitpid failed");
+        }
+      }
+      exitCode =
+          WIFEXITED(stat) ? WEXITSTATUS(stat) : 128 + WTERMSIG(stat);
+    }
+    result.code = ExitCode{exitCode};
+    pid = -1;
+  }
+
+public:
+  explicit ProcessRunner(ExecResult &into) noexcept : result(into) {
+    result.code = ExitCode{-1};
+    result.spawnError = 0;
+    result.out.clear();
+    result.err.clear();
+  }
+
+  ~ProcessRunner() noexcept {
+    close_fd(stdoutPipe[0]);
+    close_fd(stdoutPipe[1]);
+    close_fd(stderrPipe[0]);
+    close_fd(stderrPipe[1]);
+    close_fd(pidfd);
+  }
+
+  auto spawn(const std::string &cmd, const char *const *argv) noexcept
+      -> bool {
+    if (pipe2(stdoutPipe.data(), O_CLOEXEC) == -1 ||
+        pipe2(stderrPipe.data(), O_CLOEXEC) == -1) {
+      FATAL("pipe2 failed");
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    // dup2 clears O_CLOEXEC on the target, everything else gets closed on exec
+    posix_spawn_file_actions_adddup2(&actions, stdoutPipe[1], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, stderrPipe[1], STDERR_FILENO);
+    // The signal mask is inherited; don't pass on what a signalfd of ours
+    // has blocked.
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t none;
+    sigemptyset(&none);
+    posix_spawnattr_setsigmask(&attributes, &none);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGMASK);
+
+    started = std::chrono::steady_clock::now();
+    WU_TRACE_NOW(traceStarted);
+    auto *const *arguments = const_cast<char *const *>(argv);
+    // glibc implements posix_spawn with CLONE_VM | CLONE_VFORK, so we don't
+    // pay for copying our page tables like fork did.
+    const auto error =
+        cmd.find('/') != std::string::npos
+            ? posix_spawn(&pid, cmd.c_str(), &actions, &attributes,
+                          arguments, environ)
+            : posix_spawnp(&pid, cmd.c_str(), &actions, &attributes,
+                           arguments, environ);
+    result.spawnTime = std::chrono::steady_clock::now() - started;
+    WU_TRACE_RECORD(trace::Point::Spawn, traceStarted);
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attributes);
+
+    // The write ends belong to the child now. Holding on to them means we
+    // never see EOF.
+    close_fd(stdoutPipe[1]);
+    close_fd(stderrPipe[1]);
+
+    if (error != 0) {
+      const std::string_view message = strerror(error);
+      auto space = result.err.prepare(message.size());
+      std::copy(message.begin(), message.end(), space.begin());
+      result.err.commit(message.size());
+      // what a shell would report for a command it can't run
+      result.code = ExitCode{127};
+      result.spawnError = error;
+      pid = -1;
+      return false;
+    }
+
+    pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+    fcntl(stdoutPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(stderrPipe[0], F_SETFL, O_NONBLOCK);
+    return true;
+  }
+
+  // Drains stdout and stderr while the child runs, so it can never block on
+  // a full pipe, then reaps it.
+  auto wait() noexcept -> void {
+    std::array<pollfd, 2> fds{pollfd{stdoutPipe[0], POLLIN, 0},
+                              pollfd{stderrPipe[0], POLLIN, 0}};
+    auto open = 2;
+    while (open > 0) {
+      if (poll(fds.data(), fds.size(), -1) == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+        FATAL("poll on child output failed");
+      }
+      for (auto i = 0; i < 2; ++i) {
+        auto &pfd = fds[i];
+        if (pfd.fd == -1 || pfd.revents == 0) {
+          continue;
+        }
+        if (!drain(pfd.fd, i == 0 ? result.out : result.err)) {
+          // negative fds are ignored by poll
+          pfd.fd = -1;
+          --open;
+        }
+      }
+    }
+    reap();
+    result.runTime = std::chrono::steady_clock::now() - started;
+    WU_TRACE_RECORD(trace::Point::ChildRun, traceStarted);
+  }
 
-#ifdef WU_DEBUG
-  std::cout << "executing xsetwacom: '" << cmd;
+  // Same as `wait`, but lets `loop` run other things until the child's
+  // output and exit are ready. Once the pidfd is readable the child is a
+  // zombie, so reaping it doesn't block.
+  auto waitAsync(EventLoop &loop) noexcept -> Task<void> {
+    auto open = 2;
+    while (open > 0) {
+      auto output = loop.readable({stdoutPipe[0], stderrPipe[0]});
+      const auto fd = co_await output;
+      auto &pipe = fd == stdoutPipe[0] ? stdoutPipe[0] : stderrPipe[0];
+      if (!drain(pipe, fd == stdoutPipe[0] ? result.out : result.err)) {
+        close_fd(pipe);
+        --open;
+      }
+    }
+    if (pidfd != -1) {
+      auto exited = loop.readable({pidfd});
+      co_await exited;
+    }
+    reap();
+    result.runTime = std::chrono::steady_clock::now() - started;
+    WU_TRACE_RECORD(trace::Point::ChildRun, traceStarted);
+  }
+};
+
+// argv for posix_spawn: `cmd`, `args`, then a null terminator
+static std::vector<const char *>
+argument_vector(const std::string &cmd,
+                std::span<const std::string> args) noexcept {
+#if WU_DEBUG
+  // stderr: stdout may be machine-read (wu_bench, --batch)
+  std::cerr << "executing xsetwacom: '" << cmd;
   for (const auto &arg : args) {
-    std::cout << " " << arg;
+    std::cerr << " " << arg;
   }
-  std::cout << "'" << std::endl;
+  std::cerr << "'" << std::endl;
 #endif
 
-  int stdio[2];
   std::vector<const char *> arguments{};
+  arguments.reserve(args.size() + 2);
   arguments.push_back(cmd.data());
   for (const auto &a : args) {
     arguments.push_back(a.c_str());
   }
   arguments.push_back(nullptr);
+  return arguments;
+}
 
-  if (pipe(stdio) == -1) {
-    FATAL("pipe failed");
-  }
-  const auto pid = fork();
-  switch (pid) {
-  case -1: {
-    FATAL("fork failed");
-  } break;
-  case 0: {
-    if (dup2(stdio[1], STDOUT_FILENO) == -1) {
-      FATAL("dup2 for stdout failed - we wouldn't be able to read stdout from "
-            "child process");
-    }
-    close(stdio[1]);
-    execute(cmd, arguments.data());
-  } break;
-  default:
-    break;
+/*static*/
+bool ExecResult::run(const std::string &cmd, std::span<const std::string> args,
+                     ExecResult &into) noexcept {
+  const auto arguments = argument_vector(cmd, args);
+
+  ProcessRunner runner{into};
+  if (runner.spawn(cmd, arguments.data())) {
+    runner.wait();
   }
+  return into.succcess();
+}
 
-  // child stdout -> stdio[1] (which can be read from stdio[0])
-  int stat;
-  int exitCode = -1;
-  for (;;) {
-    const auto r = waitpid(pid, &stat, 0);
-    if (r == -1) {
-      FATAL("exec'ing child must have failed");
-    }
-    if (WIFEXITED(stat)) {
-      exitCode = WEXITSTATUS(stat);
-      break;
-    }
+/*static*/
+Task<std::unique_ptr<ExecResult>>
+ExecResult::execAsync(EventLoop &loop, std::string cmd,
+                      std::vector<std::string> args) noexcept {
+  const auto arguments = argument_vector(cmd, args);
+
+  auto result = std::make_unique<ExecResult>();
+  ProcessRunner runner{*result};
+  if (runner.spawn(cmd, arguments.data())) {
+    co_await runner.waitAsync(loop);
   }
-  return std::make_unique<ExecResult>(stdio[0], ExitCode{exitCode});
+  co_return result;
 }
 
-ReadResult read(std::unique_ptr<ExecResult> &&proc) noexcept {
-  char buf[512];
-  std::string result{};
-  for (auto bytes = ::read(proc->std_out(), buf, 512);;
-       ::read(proc->std_out(), buf, 512)) {
-    if (bytes == -1) {
-      if (result.size() == 0) {
-        return ReadResult{{}, errno};
-      } else {
-        break;
-      }
-    }
-    result.append(buf, bytes);
+/*static*/
+std::unique_ptr<ExecResult>
+ExecResult::exec(std::string cmd, std::span<const std::string> args) noexcept {
+  auto result = std::make_unique<ExecResult>();
+  run(cmd, args, *result);
+  return result;
+}
 
-    if (bytes != 512) {
-      break;
-    }
+ReadResult read(std::unique_ptr<ExecResult> &&proc) noexcept {
+  if (proc->spawn_error() != 0) {
+    return ReadResult{{}, proc->spawn_error()};
   }
-  return ReadResult{.data = std::move(result), .error = 0};
-}
\ No newline at end of file
+  return ReadResult{.data = std::string{proc->std_out()}, .error = 0};
+}
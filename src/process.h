@@ -1,28 +1,78 @@
 #pragma once
+#include "task.h"
+#include <chrono>
 #include <memory>
 #include <optional>
 #include <span>
-#include <thread>
+#include <string>
+#include <string_view>
 #include <unistd.h>
 #include <vector>
 
+class EventLoop;
+
 struct ExitCode {
   int code;
 };
 
+// Growable byte buffer that keeps its capacity between uses, so that running
+// the same command over and over doesn't reallocate.
+class OutputBuffer {
+  std::vector<char> bytes{};
+  std::size_t length{0};
+
+public:
+  auto clear() noexcept -> void { length = 0; }
+  auto size() const noexcept -> std::size_t { return length; }
+  auto view() const noexcept -> std::string_view {
+    return std::string_view{bytes.data(), length};
+  }
+  // Returns writable space of at least `minimum` bytes past the end of the
+  // committed data.
+  auto prepare(std::size_t minimum) noexcept -> std::span<char>;
+  auto commit(std::size_t written) noexcept -> void { length += written; }
+};
+
 class ExecResult {
-  int procStdout;
-  ExitCode code;
+  ExitCode code{-1};
+  // errno of a failed posix_spawn, the child never ran
+  int spawnError{0};
+  OutputBuffer out{};
+  OutputBuffer err{};
+  std::chrono::nanoseconds spawnTime{};
+  std::chrono::nanoseconds runTime{};
+
+  friend class ProcessRunner;
 
 public:
-  ExecResult(int out, ExitCode code) noexcept;
-  ~ExecResult() noexcept;
+  ExecResult() noexcept = default;
 
   auto succcess() const noexcept -> bool;
-  auto std_out() const noexcept -> int;
+  auto exit_code() const noexcept -> int { return code.code; }
+  auto spawn_error() const noexcept -> int { return spawnError; }
+  auto std_out() const noexcept -> std::string_view { return out.view(); }
+  auto std_err() const noexcept -> std::string_view { return err.view(); }
+  // Time spent in posix_spawn, and from spawn until the child was reaped.
+  auto spawn_time() const noexcept -> std::chrono::nanoseconds {
+    return spawnTime;
+  }
+  auto run_time() const noexcept -> std::chrono::nanoseconds {
+    return runTime;
+  }
+
   // executes `cmd` with the cli arguments `args`.
   auto static exec(std::string cmd, std::span<const std::string> args) noexcept
       -> std::unique_ptr<ExecResult>;
+  // executes `cmd` with the cli arguments `args` and stores the result in
+  // `into`, re-using its output buffers. Returns true if the child exited with
+  // status 0.
+  auto static run(const std::string &cmd, std::span<const std::string> args,
+                  ExecResult &into) noexcept -> bool;
+  // Like exec, but suspends the awaiting coroutine on `loop` while the child
+  // runs instead of blocking the thread.
+  auto static execAsync(EventLoop &loop, std::string cmd,
+                        std::vector<std::string> args) noexcept
+      -> Task<std::unique_ptr<ExecResult>>;
 };
 
 struct ReadResult {
@@ -30,4 +80,4 @@ struct ReadResult {
   int error;
 };
 
-ReadResult read(std::unique_ptr<ExecResult> &&proc) noexcept;
\ No newline at end of file
+ReadResult read(std::unique_ptr<ExecResult> &&proc) noexcept;
@@ -0,0 +1,152 @@
+#include "profiles.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr char Magic[4]{'W', 'U', 'P', 'F'};
+static constexpr std::uint32_t Version = 1;
+
+static std::string_view fixed_string(const char *data,
+                                     std::size_t size) noexcept {
+  return std::string_view{data, strnlen(data, size)};
+}
+
+std::string_view ProfileRecord::profileName() const noexcept {
+  return fixed_string(profile, sizeof(profile));
+}
+
+std::string_view ProfileRecord::deviceName() const noexcept {
+  return fixed_string(device, sizeof(device));
+}
+
+Selection ProfileRecord::selection() const noexcept {
+  return Selection{.dimensions = {width, height}, .origin = {x, y}};
+}
+
+/*static*/
+std::optional<ProfileRecord>
+ProfileRecord::make(std::string_view profile, std::string_view device,
+                    Selection selection, std::uint32_t flags) noexcept {
+  ProfileRecord record{};
+  // leave room for the terminating NUL
+  if (profile.empty() || profile.size() >= sizeof(record.profile) ||
+      device.size() >= sizeof(record.device)) {
+    return {};
+  }
+  std::ranges::copy(profile, record.profile);
+  std::ranges::copy(device, record.device);
+  record.x = selection.origin.x;
+  record.y = selection.origin.y;
+  record.width = selection.dimensions.x;
+  record.height = selection.dimensions.y;
+  record.flags = flags;
+  return record;
+}
+
+ProfileStore::ProfileStore(fs::path path) noexcept : path(std::move(path)) {
+  const auto fd = open(this->path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    // no profiles saved yet
+    return;
+  }
+  struct stat st{};
+  if (fstat(fd, &st) == -1 ||
+      static_cast<std::size_t>(st.st_size) < sizeof(ProfileFileHeader)) {
+    close(fd);
+    return;
+  }
+  mappingSize = st.st_size;
+  mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    mapping = nullptr;
+    return;
+  }
+
+  const auto *header = static_cast<const ProfileFileHeader *>(mapping);
+  const auto expectedSize =
+      sizeof(ProfileFileHeader) +
+      static_cast<std::size_t>(header->count) * sizeof(ProfileRecord);
+  if (std::memcmp(header->magic, Magic, sizeof(Magic)) != 0 ||
+      header->version != Version ||
+      header->recordSize != sizeof(ProfileRecord) ||
+      expectedSize > mappingSize) {
+    std::cerr << "Ignoring unreadable profile store " << this->path
+              << std::endl;
+    return;
+  }
+  records = std::span<const ProfileRecord>{
+      reinterpret_cast<const ProfileRecord *>(header + 1), header->count};
+}
+
+ProfileStore::~ProfileStore() noexcept {
+  if (mapping != nullptr) {
+    munmap(mapping, mappingSize);
+  }
+}
+
+/*static*/ fs::path ProfileStore::defaultPath() noexcept {
+  if (const auto config = std::getenv("XDG_CONFIG_HOME");
+      config != nullptr && config[0] != '\0') {
+    return fs::path{config} / "wu" / "profiles.bin";
+  }
+  const auto home = std::getenv("HOME");
+  return fs::path{home != nullptr ? home : "/"} / ".config" / "wu" /
+         "profiles.bin";
+}
+
+static bool by_profile(const ProfileRecord &a, const ProfileRecord &b) noexcept {
+  return a.profileName() < b.profileName();
+}
+
+std::span<const ProfileRecord>
+ProfileStore::find(std::string_view name) const noexcept {
+  const auto [first, last] = std::ranges::equal_range(
+      records, name, std::less{}, &ProfileRecord::profileName);
+  return std::span<const ProfileRecord>{first, last};
+}
+
+bool ProfileStore::save(const ProfileRecord &record) const noexcept {
+  std::vector<ProfileRecord> updated{records.begin(), records.end()};
+  std::erase_if(updated, [&](const ProfileRecord &r) {
+    return r.profileName() == record.profileName() &&
+           r.deviceName() == record.deviceName();
+  });
+  updated.push_back(record);
+  std::ranges::stable_sort(updated, by_profile);
+
+  std::error_code err;
+  fs::create_directories(path.parent_path(), err);
+  auto tmp = path;
+  tmp += ".tmp";
+  const auto fd =
+      open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    std::cerr << "Could not write " << tmp << ": " << strerror(errno)
+              << std::endl;
+    return false;
+  }
+  ProfileFileHeader header{};
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.recordSize = sizeof(ProfileRecord);
+  header.count = static_cast<std::uint32_t>(updated.size());
+  const auto bytes = updated.size() * sizeof(ProfileRecord);
+  const auto ok =
+      write(fd, &header, sizeof(header)) == sizeof(header) &&
+      write(fd, updated.data(), bytes) == static_cast<ssize_t>(bytes) &&
+      fsync(fd) == 0;
+  close(fd);
+  if (!ok || rename(tmp.c_str(), path.c_str()) == -1) {
+    std::cerr << "Could not write " << path << ": " << strerror(errno)
+              << std::endl;
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "selection.h"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// On-disk layout of the profile store. A profile is every record sharing a
+// profile name, one per device it maps. Records are kept sorted by profile
+// name so a lookup is a binary search over the mapped file, no parsing.
+struct ProfileFileHeader {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t recordSize;
+  std::uint32_t count;
+};
+
+enum ProfileFlags : std::uint32_t {
+  KeepAspect = 1 << 0,
+  WholeTablet = 1 << 1,
+  HasRotation = 1 << 2,
+  HasPressureCurve = 1 << 3,
+};
+
+struct ProfileRecord {
+  char profile[48];
+  char device[128];
+  std::int32_t x, y, width, height;
+  std::uint32_t flags;
+  // TabletRotation, valid with HasRotation
+  std::int32_t rotation;
+  // valid with HasPressureCurve
+  std::int32_t pressureCurve[4];
+  // room for tool parameters without bumping the record size
+  std::uint8_t reserved[40];
+
+  auto profileName() const noexcept -> std::string_view;
+  auto deviceName() const noexcept -> std::string_view;
+  auto selection() const noexcept -> Selection;
+
+  static auto make(std::string_view profile, std::string_view device,
+                   Selection selection, std::uint32_t flags) noexcept
+      -> std::optional<ProfileRecord>;
+};
+static_assert(sizeof(ProfileRecord) == 256);
+
+// Read-only view of the profile file, mmap'd for as long as the store lives
+class ProfileStore {
+  fs::path path;
+  void *mapping{nullptr};
+  std::size_t mappingSize{0};
+  std::span<const ProfileRecord> records{};
+
+public:
+  explicit ProfileStore(fs::path path) noexcept;
+  ~ProfileStore() noexcept;
+  ProfileStore(const ProfileStore &) = delete;
+  ProfileStore &operator=(const ProfileStore &) = delete;
+
+  // $XDG_CONFIG_HOME/wu/profiles.bin, or ~/.config/wu/profiles.bin
+  static auto defaultPath() noexcept -> fs::path;
+
+  auto all() const noexcept -> std::span<const ProfileRecord> {
+    return records;
+  }
+  // All records of profile `name`
+  auto find(std::string_view name) const noexcept
+      -> std::span<const ProfileRecord>;
+
+  // Adds `record` to the file, replacing the record for the same profile and
+  // device. The file is rewritten and atomically renamed into place; this
+  // store keeps seeing the old contents.
+  auto save(const ProfileRecord &record) const noexcept -> bool;
+};
@@ -0,0 +1,56 @@
+#include "rules.h"
+#include "util.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+/*static*/ fs::path RuleTable::defaultPath() noexcept {
+  if (const auto config = std::getenv("XDG_CONFIG_HOME");
+      config != nullptr && config[0] != '\0') {
+    return fs::path{config} / "wu" / "rules";
+  }
+  const auto home = std::getenv("HOME");
+  return fs::path{home != nullptr ? home : "/"} / ".config" / "wu" / "rules";
+}
+
+bool RuleTable::load(const fs::path &path) noexcept {
+  std::ifstream file{path};
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  auto lineNumber = 0;
+  while (std::getline(file, line)) {
+    ++lineNumber;
+    std::ranges::replace(line, '\t', ' ');
+    const auto content = std::string_view{line}.substr(0, line.find('#'));
+    const auto words = wu::split_string(content, ' ');
+    if (words.empty()) {
+      continue;
+    }
+    if (words.size() != 2) {
+      std::cerr << path.string() << ":" << lineNumber
+                << ": expected '<window class> <profile>'" << std::endl;
+      continue;
+    }
+    if (words[0] == "*") {
+      fallback = std::string{words[1]};
+    } else {
+      rules.insert_or_assign(std::string{words[0]}, std::string{words[1]});
+    }
+  }
+  return true;
+}
+
+std::optional<std::string_view>
+RuleTable::lookup(std::string_view instance,
+                  std::string_view windowClass) const noexcept {
+  if (const auto it = rules.find(windowClass); it != rules.end()) {
+    return it->second;
+  }
+  if (const auto it = rules.find(instance); it != rules.end()) {
+    return it->second;
+  }
+  return fallback;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+
+// Maps window classes to profile names, for switching the mapping when the
+// focused application changes. The file is line based:
+//   # comment
+//   krita     painting
+//   firefox   browsing
+//   *         default
+// where the first column is matched against either part of WM_CLASS
+// (instance or class name) and `*` matches windows no other rule matches.
+class RuleTable {
+  struct Hash {
+    using is_transparent = void;
+    auto operator()(std::string_view str) const noexcept -> std::size_t {
+      return std::hash<std::string_view>{}(str);
+    }
+  };
+  std::unordered_map<std::string, std::string, Hash, std::equal_to<>> rules{};
+  std::optional<std::string> fallback{};
+
+public:
+  // $XDG_CONFIG_HOME/wu/rules, or ~/.config/wu/rules
+  static auto defaultPath() noexcept -> fs::path;
+  // Returns false if the file can't be read
+  auto load(const fs::path &path) noexcept -> bool;
+  auto size() const noexcept -> std::size_t { return rules.size(); }
+  // The profile for a window with WM_CLASS `instance`, `windowClass`
+  auto lookup(std::string_view instance,
+              std::string_view windowClass) const noexcept
+      -> std::optional<std::string_view>;
+};
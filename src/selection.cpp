@@ -1,4 +1,33 @@
 #include "selection.h"
+#include <X11/X.h>
+#include <charconv>
+
+std::optional<Selection>
+selection_from_geometry(std::string_view text) noexcept {
+  Selection result{};
+  const auto *it = text.data();
+  const auto *end = text.data() + text.size();
+  constexpr char Separators[]{'x', '+', '+'};
+  int *fields[]{&result.dimensions.x, &result.dimensions.y, &result.origin.x,
+                &result.origin.y};
+  for (auto i = 0uz; i < std::size(fields); ++i) {
+    if (i > 0) {
+      if (it == end || *it != Separators[i - 1]) {
+        return {};
+      }
+      ++it;
+    }
+    const auto parse = std::from_chars(it, end, *fields[i]);
+    if (parse.ec != std::errc() || *fields[i] < 0) {
+      return {};
+    }
+    it = parse.ptr;
+  }
+  if (it != end || result.dimensions.x == 0 || result.dimensions.y == 0) {
+    return {};
+  }
+  return result;
+}
 
 void ActiveSelection::on_click(int x, int y) noexcept {
   clickPos = Vec2{.x = x, .y = y};
@@ -13,6 +42,19 @@ void ActiveSelection::on_release(int x, int y) noexcept {
   releasePos = Vec2{.x = x, .y = y};
 }
 
+bool ActiveSelection::on_event(int type, unsigned int button, int x,
+                               int y) noexcept {
+  if (type == ButtonPress && button == Button1) {
+    on_click(x, y);
+  } else if (type == MotionNotify && selecting()) {
+    on_move(x, y);
+  } else if (type == ButtonRelease && button == Button1 && clickPos) {
+    on_release(x, y);
+    return true;
+  }
+  return false;
+}
+
 Selection ActiveSelection::selection() const noexcept {
   return Selection{dimensions(), origin()};
 }
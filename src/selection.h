@@ -1,16 +1,35 @@
 #pragma once
+#include "format.h"
 #include <iostream>
 #include <optional>
+#include <string_view>
 
 struct Vec2 {
   int x, y;
+
+  friend constexpr bool operator==(const Vec2 &, const Vec2 &) = default;
 };
 
 struct Selection {
   Vec2 dimensions;
   Vec2 origin;
+
+  friend constexpr bool operator==(const Selection &,
+                                   const Selection &) = default;
 };
 
+// Selection as an X geometry string, "WxH+X+Y"
+inline auto geometry(const Selection &selection) noexcept
+    -> wu::FixedString<48> {
+  const auto [dimensions, origin] = selection;
+  return wu::format<48>("{}x{}+{}+{}", dimensions.x, dimensions.y, origin.x,
+                        origin.y);
+}
+
+// "WxH+X+Y" back into a Selection, if that's what `text` is
+auto selection_from_geometry(std::string_view text) noexcept
+    -> std::optional<Selection>;
+
 struct ActiveSelection {
   std::optional<Vec2> clickPos{};
   Vec2 currentPos{};
@@ -23,6 +42,10 @@ struct ActiveSelection {
   auto on_click(int x, int y) noexcept -> void;
   auto on_move(int x, int y) noexcept -> void;
   auto on_release(int x, int y) noexcept -> void;
+  // Feeds a pointer event (ButtonPress, MotionNotify or ButtonRelease, in root
+  // window coordinates) to the selection. Returns true once the selection is
+  // complete.
+  auto on_event(int type, unsigned int button, int x, int y) noexcept -> bool;
   auto selection() const noexcept -> Selection;
   auto current_selection() const noexcept -> Selection;
 
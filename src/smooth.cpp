@@ -0,0 +1,272 @@
+#include "smooth.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/uinput.h>
+#include <numbers>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+using namespace std::string_view_literals;
+
+static std::int64_t time_us(const input_event &event) noexcept {
+  return static_cast<std::int64_t>(event.input_event_sec) * 1'000'000 +
+         event.input_event_usec;
+}
+
+static FilterLanes absolute(const FilterLanes &lanes) noexcept {
+  return lanes < 0 ? -lanes : lanes;
+}
+
+std::optional<FilterConfig> filter_from_string(std::string_view text) noexcept {
+  FilterConfig config{};
+  const auto colon = text.find(':');
+  const auto kind = text.substr(0, colon);
+  std::array<float *, 2> parameters{};
+  if (kind == "one-euro"sv) {
+    config.kind = FilterConfig::Kind::OneEuro;
+    parameters = {&config.minCutoff, &config.beta};
+  } else if (kind == "ema"sv) {
+    config.kind = FilterConfig::Kind::AdaptiveEma;
+    parameters = {&config.minAlpha, &config.speed};
+  } else {
+    return {};
+  }
+  auto rest = colon == std::string_view::npos ? std::string_view{}
+                                              : text.substr(colon + 1);
+  for (auto *parameter : parameters) {
+    if (rest.empty()) {
+      break;
+    }
+    const auto next = rest.find(':');
+    const auto number = std::string{rest.substr(0, next)};
+    char *end = nullptr;
+    *parameter = std::strtof(number.c_str(), &end);
+    if (number.empty() || end != number.c_str() + number.size() ||
+        *parameter < 0) {
+      return {};
+    }
+    rest = next == std::string_view::npos ? std::string_view{}
+                                          : rest.substr(next + 1);
+  }
+  if (!rest.empty() || config.minAlpha > 1 || config.speed == 0) {
+    return {};
+  }
+  return config;
+}
+
+const FilterLanes &PenFilter::apply(const FilterLanes &raw,
+                                    std::int64_t timeUs) noexcept {
+  // How far a low pass with `cutoff` Hz moves towards a new sample `dt`
+  // seconds after the last one
+  const auto alpha = [](const auto &cutoff, float dt) noexcept {
+    const auto r = 2 * std::numbers::pi_v<float> * cutoff * dt;
+    return r / (r + 1);
+  };
+  // The One Euro filter's fixed cutoff for the speed itself
+  constexpr auto DerivativeCutoff = 1.0f;
+
+  if (!primed) {
+    value = raw;
+    derivative = FilterLanes{};
+    lastUs = timeUs;
+    primed = true;
+    return value;
+  }
+  // Reports without a timestamp step (or with a backwards one) still count
+  const auto dt = std::max(1e-4f, (timeUs - lastUs) * 1e-6f);
+  lastUs = timeUs;
+  const auto delta = raw - value;
+  switch (config.kind) {
+  case FilterConfig::Kind::OneEuro: {
+    derivative += alpha(DerivativeCutoff, dt) * (delta / dt - derivative);
+    const FilterLanes cutoff =
+        config.minCutoff + config.beta * absolute(derivative);
+    value += alpha(cutoff, dt) * delta;
+    break;
+  }
+  case FilterConfig::Kind::AdaptiveEma: {
+    const FilterLanes fraction = absolute(delta) / (dt * config.speed);
+    const FilterLanes capped = fraction < 1 ? fraction : FilterLanes{} + 1;
+    value += (config.minAlpha + (1 - config.minAlpha) * capped) * delta;
+    break;
+  }
+  }
+  return value;
+}
+
+void Smoother::endReport(const input_event &syn) noexcept {
+  if (inProximity) {
+    const auto &filtered = filter.apply(raw, time_us(syn));
+    for (auto c = 0uz; c < Channels.size(); ++c) {
+      if (!seen[c]) {
+        continue;
+      }
+      const auto smoothed =
+          static_cast<std::int32_t>(std::lround(filtered[c]));
+      if (slots[c] != -1) {
+        out[static_cast<std::size_t>(slots[c])].value = smoothed;
+      } else if (smoothed != emitted[c]) {
+        // Still settling towards a position the device stopped repeating
+        auto &event = out[count++];
+        event = syn;
+        event.type = EV_ABS;
+        event.code = Channels[c];
+        event.value = smoothed;
+      }
+      emitted[c] = smoothed;
+    }
+  } else {
+    for (auto c = 0uz; c < Channels.size(); ++c) {
+      emitted[c] = static_cast<std::int32_t>(raw[c]);
+    }
+  }
+  slots.fill(-1);
+  out[count++] = syn;
+}
+
+std::span<const input_event>
+Smoother::process(std::span<const input_event> events) noexcept {
+  // What was handed out has been written; keep the report in progress
+  std::move(out.begin() + handedOut, out.begin() + count, out.begin());
+  for (auto &slot : slots) {
+    if (slot != -1) {
+      slot -= static_cast<std::ptrdiff_t>(handedOut);
+    }
+  }
+  count -= handedOut;
+  handedOut = 0;
+  // No pen sends reports anywhere near this long; pass it on as it is
+  if (count > BatchSize) {
+    handedOut = count;
+    slots.fill(-1);
+  }
+
+  events = events.first(std::min(events.size(), BatchSize));
+  for (const auto &event : events) {
+    switch (event.type) {
+    case EV_ABS:
+      for (auto c = 0uz; c < Channels.size(); ++c) {
+        if (event.code == Channels[c]) {
+          raw[c] = static_cast<float>(event.value);
+          seen[c] = true;
+          slots[c] = static_cast<std::ptrdiff_t>(count);
+        }
+      }
+      break;
+    case EV_KEY:
+      if (event.code >= BTN_TOOL_PEN && event.code <= BTN_TOOL_LENS) {
+        inProximity = event.value != 0;
+        if (!inProximity) {
+          filter.reset();
+        }
+      }
+      break;
+    case EV_SYN:
+      if (event.code == SYN_REPORT) {
+        endReport(event);
+        handedOut = count;
+        continue;
+      }
+      if (event.code == SYN_DROPPED) {
+        filter.reset();
+      }
+      break;
+    default:
+      break;
+    }
+    out[count++] = event;
+  }
+  return std::span<const input_event>{out.data(), handedOut};
+}
+
+static constexpr auto LongBits = sizeof(unsigned long) * CHAR_BIT;
+
+static bool test_bit(const unsigned long *bits, unsigned int bit) noexcept {
+  return (bits[bit / LongBits] >> (bit % LongBits)) & 1;
+}
+
+VirtualTablet::VirtualTablet(int source) noexcept
+    : fd(open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC)) {
+  if (fd == -1) {
+    return;
+  }
+  // The event types and codes worth copying, with the uinput request that
+  // enables each code
+  constexpr std::pair<unsigned int, unsigned long> Types[]{
+      {EV_KEY, UI_SET_KEYBIT},
+      {EV_ABS, UI_SET_ABSBIT},
+      {EV_REL, UI_SET_RELBIT},
+      {EV_MSC, UI_SET_MSCBIT}};
+  unsigned long types[EV_CNT / LongBits + 1]{};
+  ioctl(source, EVIOCGBIT(0, sizeof(types)), types);
+  for (const auto &[type, request] : Types) {
+    if (!test_bit(types, type)) {
+      continue;
+    }
+    unsigned long codes[KEY_CNT / LongBits + 1]{};
+    ioctl(source, EVIOCGBIT(type, sizeof(codes)), codes);
+    ioctl(fd, UI_SET_EVBIT, type);
+    for (auto code = 0u; code < KEY_CNT; ++code) {
+      if (!test_bit(codes, code)) {
+        continue;
+      }
+      ioctl(fd, request, code);
+      if (type == EV_ABS) {
+        uinput_abs_setup axis{};
+        axis.code = static_cast<std::uint16_t>(code);
+        if (ioctl(source, EVIOCGABS(code), &axis.absinfo) == 0) {
+          ioctl(fd, UI_ABS_SETUP, &axis);
+        }
+      }
+    }
+  }
+  unsigned long properties[INPUT_PROP_CNT / LongBits + 1]{};
+  ioctl(source, EVIOCGPROP(sizeof(properties)), properties);
+  for (auto property = 0u; property < INPUT_PROP_CNT; ++property) {
+    if (test_bit(properties, property)) {
+      ioctl(fd, UI_SET_PROPBIT, property);
+    }
+  }
+
+  // Same ids as the real tablet, so the X driver treats it as that model
+  uinput_setup setup{};
+  ioctl(source, EVIOCGID, &setup.id);
+  char sourceName[UINPUT_MAX_NAME_SIZE]{};
+  ioctl(source, EVIOCGNAME(sizeof(sourceName) - 1), sourceName);
+  deviceName = std::string{sourceName} + " smoothed";
+  deviceName.resize(std::min(deviceName.size(), sizeof(setup.name) - 1));
+  std::memcpy(setup.name, deviceName.data(), deviceName.size());
+  if (ioctl(fd, UI_DEV_SETUP, &setup) == -1 ||
+      ioctl(fd, UI_DEV_CREATE) == -1) {
+    close(fd);
+    fd = -1;
+  }
+}
+
+VirtualTablet::~VirtualTablet() noexcept {
+  if (fd != -1) {
+    ioctl(fd, UI_DEV_DESTROY);
+    close(fd);
+  }
+}
+
+bool VirtualTablet::emit(std::span<const input_event> events) noexcept {
+  const auto *data = reinterpret_cast<const char *>(events.data());
+  const auto bytes = events.size_bytes();
+  for (std::size_t written = 0; written < bytes;) {
+    const auto result = write(fd, data + written, bytes - written);
+    if (result == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    written += static_cast<std::size_t>(result);
+  }
+  return true;
+}
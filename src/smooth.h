@@ -0,0 +1,107 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <linux/input.h>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+// Pen smoothing (`wu --smooth`): the tablet's evdev node is grabbed, its
+// reports run through a filter and re-emitted by a uinput tablet that X then
+// picks up like the real one. Everything on the per-event path works in
+// fixed buffers.
+
+// Position and tilt, filtered side by side, one lane each
+typedef float FilterLanes __attribute__((vector_size(16)));
+
+struct FilterConfig {
+  enum class Kind { OneEuro, AdaptiveEma };
+  Kind kind{Kind::OneEuro};
+  // One Euro: the cutoff (Hz) at rest, and how fast it rises with speed (per
+  // device unit per second)
+  float minCutoff{1.0f};
+  float beta{0.002f};
+  // Adaptive EMA: the weight of a new report at rest, reaching 1 at `speed`
+  // device units per second
+  float minAlpha{0.3f};
+  float speed{20000.0f};
+};
+
+// "one-euro[:MINCUTOFF[:BETA]]" or "ema[:MINALPHA[:SPEED]]"
+auto filter_from_string(std::string_view text) noexcept
+    -> std::optional<FilterConfig>;
+
+// One Euro filter (Casiez et al. 2012) or an exponential moving average
+// whose weight grows with speed: both lag little while the pen moves fast
+// and smooth hard while it's slow, which is where shaking shows.
+class PenFilter {
+  FilterConfig config;
+  FilterLanes value{};
+  FilterLanes derivative{};
+  std::int64_t lastUs{0};
+  bool primed{false};
+
+public:
+  explicit PenFilter(const FilterConfig &config) noexcept : config(config) {}
+  // Forgets the stroke; the next report passes through as is
+  auto reset() noexcept -> void { primed = false; }
+  auto apply(const FilterLanes &raw, std::int64_t timeUs) noexcept
+      -> const FilterLanes &;
+};
+
+// Rewrites an evdev stream with filtered positions, a report at a time
+class Smoother {
+public:
+  // Most events process() takes in one go
+  static constexpr auto BatchSize = 512uz;
+
+private:
+  static constexpr std::array<std::uint16_t, 4> Channels{ABS_X, ABS_Y,
+                                                         ABS_TILT_X,
+                                                         ABS_TILT_Y};
+  // Each report can gain an event per channel that didn't change raw but did
+  // filtered, and there may be the start of a report left from last time
+  static constexpr auto Capacity = BatchSize * (Channels.size() + 2);
+
+  PenFilter filter;
+  std::array<input_event, Capacity> out{};
+  std::size_t count{0};
+  // what the last process() returned
+  std::size_t handedOut{0};
+  FilterLanes raw{};
+  std::array<std::int32_t, Channels.size()> emitted{};
+  // where in `out` the current report set each channel, -1 if it didn't
+  std::array<std::ptrdiff_t, Channels.size()> slots{-1, -1, -1, -1};
+  // channels the device has reported at all
+  std::array<bool, Channels.size()> seen{};
+  bool inProximity{true};
+
+  auto endReport(const input_event &syn) noexcept -> void;
+
+public:
+  explicit Smoother(const FilterConfig &config) noexcept : filter(config) {}
+
+  // Takes up to BatchSize events and returns every complete report so far,
+  // filtered, until the next call
+  auto process(std::span<const input_event> events) noexcept
+      -> std::span<const input_event>;
+};
+
+// A uinput device that can report everything the evdev device `source` can,
+// named after it
+class VirtualTablet {
+  int fd{-1};
+  std::string deviceName{};
+
+public:
+  explicit VirtualTablet(int source) noexcept;
+  ~VirtualTablet() noexcept;
+  VirtualTablet(const VirtualTablet &) = delete;
+  VirtualTablet &operator=(const VirtualTablet &) = delete;
+
+  auto isOpen() const noexcept -> bool { return fd != -1; }
+  // What X will list it as
+  auto name() const noexcept -> const std::string & { return deviceName; }
+  auto emit(std::span<const input_event> events) noexcept -> bool;
+};
@@ -0,0 +1,107 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+// Lazily started coroutine that produces a T. `co_await` it from another
+// coroutine to run it and get its value, or hand it to an EventLoop to run it
+// at the top level. Resuming the awaiting coroutine when done is a symmetric
+// transfer, so chains of tasks don't grow the stack.
+template <typename T = void> class Task;
+
+namespace detail {
+struct TaskPromiseBase {
+  std::coroutine_handle<> continuation{std::noop_coroutine()};
+
+  struct FinalAwaiter {
+    auto await_ready() const noexcept -> bool { return false; }
+    template <typename Promise>
+    auto await_suspend(std::coroutine_handle<Promise> handle) const noexcept
+        -> std::coroutine_handle<> {
+      return handle.promise().continuation;
+    }
+    auto await_resume() const noexcept -> void {}
+  };
+
+  auto initial_suspend() const noexcept -> std::suspend_always { return {}; }
+  auto final_suspend() const noexcept -> FinalAwaiter { return {}; }
+  // Everything we await is noexcept
+  auto unhandled_exception() const noexcept -> void { std::terminate(); }
+};
+
+template <typename T> struct TaskPromise : TaskPromiseBase {
+  std::optional<T> value{};
+
+  auto get_return_object() noexcept -> Task<T>;
+  auto return_value(T result) noexcept -> void { value = std::move(result); }
+  auto result() noexcept -> T { return std::move(value).value(); }
+};
+
+template <> struct TaskPromise<void> : TaskPromiseBase {
+  auto get_return_object() noexcept -> Task<void>;
+  auto return_void() const noexcept -> void {}
+  auto result() const noexcept -> void {}
+};
+} // namespace detail
+
+template <typename T> class [[nodiscard]] Task {
+public:
+  using promise_type = detail::TaskPromise<T>;
+
+private:
+  std::coroutine_handle<promise_type> handle{};
+
+  struct Awaiter {
+    std::coroutine_handle<promise_type> handle;
+
+    auto await_ready() const noexcept -> bool { return false; }
+    auto await_suspend(std::coroutine_handle<> awaiting) const noexcept
+        -> std::coroutine_handle<> {
+      handle.promise().continuation = awaiting;
+      return handle;
+    }
+    auto await_resume() const noexcept -> T {
+      return handle.promise().result();
+    }
+  };
+
+public:
+  Task() noexcept = default;
+  explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+      : handle(handle) {}
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (handle) {
+        handle.destroy();
+      }
+      handle = std::exchange(other.handle, {});
+    }
+    return *this;
+  }
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task() noexcept {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  auto done() const noexcept -> bool { return !handle || handle.done(); }
+  // Runs the task until its first suspension; for top level tasks only
+  auto start() const noexcept -> void { handle.resume(); }
+  auto operator co_await() && noexcept -> Awaiter { return Awaiter{handle}; }
+};
+
+namespace detail {
+template <typename T>
+auto TaskPromise<T>::get_return_object() noexcept -> Task<T> {
+  return Task<T>{std::coroutine_handle<TaskPromise<T>>::from_promise(*this)};
+}
+
+inline auto TaskPromise<void>::get_return_object() noexcept -> Task<void> {
+  return Task<void>{
+      std::coroutine_handle<TaskPromise<void>>::from_promise(*this)};
+}
+} // namespace detail
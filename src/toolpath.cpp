@@ -0,0 +1,101 @@
+#include "toolpath.h"
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <sys/stat.h>
+#include <system_error>
+
+namespace toolpath {
+
+fs::path cache_path(std::string_view tool) noexcept {
+  const auto file = std::string{tool} + ".path";
+  if (const auto cache = std::getenv("XDG_CACHE_HOME");
+      cache != nullptr && cache[0] != '\0') {
+    return fs::path{cache} / "wu" / file;
+  }
+  const auto home = std::getenv("HOME");
+  return fs::path{home != nullptr ? home : "/"} / ".cache" / "wu" / file;
+}
+
+// mtime in ns of the executable regular file at `path`
+static std::optional<std::int64_t>
+executable_mtime(const char *path) noexcept {
+  struct stat info;
+  if (stat(path, &info) == -1 || !S_ISREG(info.st_mode) ||
+      (info.st_mode & 0111) == 0) {
+    return {};
+  }
+  return static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1'000'000'000 +
+         info.st_mtim.tv_nsec;
+}
+
+// The cache file holds three lines: PATH, the binary's mtime, the binary
+static std::optional<fs::path> read_cache(const fs::path &cacheFile,
+                                          std::string_view pathEnv) noexcept {
+  std::ifstream file{cacheFile};
+  std::string cachedPathEnv;
+  std::string mtime;
+  std::string binary;
+  if (!std::getline(file, cachedPathEnv) || !std::getline(file, mtime) ||
+      !std::getline(file, binary) || cachedPathEnv != pathEnv) {
+    return {};
+  }
+  const auto current = executable_mtime(binary.c_str());
+  if (!current || std::to_string(current.value()) != mtime) {
+    return {};
+  }
+  return fs::path{std::move(binary)};
+}
+
+static void write_cache(const fs::path &cacheFile, std::string_view pathEnv,
+                        std::int64_t mtime, const fs::path &binary) noexcept {
+  std::error_code error;
+  fs::create_directories(cacheFile.parent_path(), error);
+  // Write aside and rename, so a concurrent reader sees all of it or none
+  auto temporary = cacheFile;
+  temporary += ".tmp";
+  {
+    std::ofstream file{temporary, std::ios::trunc};
+    file << pathEnv << "\n" << mtime << "\n" << binary.native() << "\n";
+    if (!file) {
+      fs::remove(temporary, error);
+      return;
+    }
+  }
+  fs::rename(temporary, cacheFile, error);
+}
+
+std::expected<fs::path, const char *> find(std::string_view tool,
+                                           const fs::path &cacheFile) noexcept {
+  const auto pathEnv = std::getenv("PATH");
+  if (pathEnv == nullptr) {
+    return std::unexpected{"$PATH is not set"};
+  }
+  if (auto cached = read_cache(cacheFile, pathEnv); cached) {
+    return std::move(cached.value());
+  }
+
+  std::string_view entries{pathEnv};
+  std::string candidate{};
+  while (!entries.empty()) {
+    const auto end = entries.find(':');
+    const auto directory = entries.substr(0, end);
+    entries = end == std::string_view::npos ? std::string_view{}
+                                            : entries.substr(end + 1);
+    if (directory.empty()) {
+      continue;
+    }
+    candidate.assign(directory);
+    candidate += '/';
+    candidate += tool;
+    if (const auto mtime = executable_mtime(candidate.c_str()); mtime) {
+      fs::path binary{std::move(candidate)};
+      write_cache(cacheFile, pathEnv, mtime.value(), binary);
+      return binary;
+    }
+  }
+  return std::unexpected{"not found on $PATH"};
+}
+} // namespace toolpath
@@ -0,0 +1,21 @@
+#pragma once
+#include <expected>
+#include <filesystem>
+#include <string_view>
+
+namespace fs = std::filesystem;
+
+// Where external tools (xsetwacom) live. Searching $PATH costs a stat per
+// entry, so the result is remembered in a small cache file along with the
+// PATH it was found on and the binary's mtime; as long as neither changed,
+// later runs only stat the one binary.
+namespace toolpath {
+
+// $XDG_CACHE_HOME/wu/<tool>.path, or ~/.cache/wu/<tool>.path
+auto cache_path(std::string_view tool) noexcept -> fs::path;
+
+// The first executable `tool` on $PATH, from `cacheFile` when it's still
+// valid. Refreshes `cacheFile` after searching.
+auto find(std::string_view tool, const fs::path &cacheFile) noexcept
+    -> std::expected<fs::path, const char *>;
+} // namespace toolpath
@@ -0,0 +1,232 @@
+#include "trace.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+namespace trace {
+
+std::string_view name(Point point) noexcept {
+  switch (point) {
+  case Point::AppInit:
+    return "app init";
+  case Point::DisplayOpen:
+    return "display open";
+  case Point::DeviceQuery:
+    return "device query";
+  case Point::Selection:
+    return "selection";
+  case Point::CommandBuild:
+    return "command build";
+  case Point::Spawn:
+    return "spawn";
+  case Point::ChildRun:
+    return "child run";
+  case Point::Apply:
+    return "apply";
+  case Point::Count:
+    break;
+  }
+  return "unknown";
+}
+
+static constexpr auto PointCount = static_cast<std::size_t>(Point::Count);
+
+// Log-linear buckets like an HDR histogram: 16 linear sub-buckets per power
+// of two, so every bucket is within ~6% of the values it holds.
+class Histogram {
+  static constexpr auto SubBucketBits = 4;
+  static constexpr auto SubBuckets = 1u << SubBucketBits;
+  static constexpr auto BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+  std::array<std::atomic<std::uint64_t>, BucketCount> counts{};
+  // exact, where the buckets only give a lower bound
+  std::atomic<std::uint64_t> largest{0};
+
+  static constexpr auto index(std::uint64_t value) noexcept -> std::size_t {
+    if (value < SubBuckets) {
+      return value;
+    }
+    const auto shift = std::bit_width(value) - 1 - SubBucketBits;
+    return (shift + 1) * SubBuckets + ((value >> shift) & (SubBuckets - 1));
+  }
+
+  static constexpr auto lowerBound(std::size_t index) noexcept
+      -> std::uint64_t {
+    if (index < SubBuckets) {
+      return index;
+    }
+    const auto shift = index / SubBuckets - 1;
+    return (SubBuckets + index % SubBuckets) << shift;
+  }
+
+public:
+  auto add(std::uint64_t value) noexcept -> void {
+    counts[index(value)].fetch_add(1, std::memory_order_relaxed);
+    auto seen = largest.load(std::memory_order_relaxed);
+    while (seen < value && !largest.compare_exchange_weak(
+                               seen, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  auto max() const noexcept -> std::uint64_t {
+    return largest.load(std::memory_order_relaxed);
+  }
+
+  auto total() const noexcept -> std::uint64_t {
+    std::uint64_t sum = 0;
+    for (const auto &count : counts) {
+      sum += count.load(std::memory_order_relaxed);
+    }
+    return sum;
+  }
+
+  // Lower bound of the bucket holding the `quantile` (0-1) value
+  auto percentile(double quantile) const noexcept -> std::uint64_t {
+    const auto rank = static_cast<std::uint64_t>(quantile * (total() - 1));
+    std::uint64_t seen = 0;
+    for (auto i = 0uz; i < counts.size(); ++i) {
+      seen += counts[i].load(std::memory_order_relaxed);
+      if (seen > rank) {
+        return lowerBound(i);
+      }
+    }
+    return 0;
+  }
+};
+
+// Multi-producer ring that overwrites its oldest spans. Each slot carries a
+// sequence number, so a reader can tell a finished span from one that is
+// being written.
+class Ring {
+public:
+  static constexpr auto Capacity = 8192uz;
+  static constexpr auto Writing = std::numeric_limits<std::uint64_t>::max();
+
+  struct Span {
+    std::uint64_t begin;
+    std::uint64_t end;
+    std::uint32_t thread;
+    Point point;
+  };
+
+private:
+  struct Slot {
+    std::atomic<std::uint64_t> sequence{0};
+    Span span;
+  };
+  std::array<Slot, Capacity> slots{};
+  std::atomic<std::uint64_t> head{0};
+
+public:
+  auto push(const Span &span) noexcept -> void {
+    const auto position = head.fetch_add(1, std::memory_order_relaxed);
+    auto &slot = slots[position % Capacity];
+    slot.sequence.store(Writing, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.span = span;
+    slot.sequence.store(position + 1, std::memory_order_release);
+  }
+
+  // The spans that are complete, oldest first
+  auto collect() const noexcept -> std::vector<Span> {
+    std::vector<std::pair<std::uint64_t, Span>> found{};
+    found.reserve(Capacity);
+    for (const auto &slot : slots) {
+      const auto before = slot.sequence.load(std::memory_order_acquire);
+      if (before == 0 || before == Writing) {
+        continue;
+      }
+      const auto span = slot.span;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) == before) {
+        found.emplace_back(before, span);
+      }
+    }
+    std::ranges::sort(found, {}, &std::pair<std::uint64_t, Span>::first);
+    std::vector<Span> result{};
+    result.reserve(found.size());
+    for (const auto &[sequence, span] : found) {
+      result.push_back(span);
+    }
+    return result;
+  }
+};
+
+static Ring Spans{};
+static std::array<Histogram, PointCount> Histograms{};
+static std::uint64_t BaseTicks = 0;
+static std::chrono::steady_clock::time_point BaseTime{};
+
+static std::uint32_t thread_id() noexcept {
+  static std::atomic<std::uint32_t> next{1};
+  thread_local const auto id = next.fetch_add(1, std::memory_order_relaxed);
+  return id;
+}
+
+void enable() noexcept {
+  BaseTime = std::chrono::steady_clock::now();
+  BaseTicks = now();
+  detail::Enabled.store(true, std::memory_order_release);
+}
+
+void record(Point point, std::uint64_t begin, std::uint64_t end) noexcept {
+  // a begin of 0 was taken while tracing was off
+  if (!enabled() || begin == 0 || end < begin) {
+    return;
+  }
+  Histograms[static_cast<std::size_t>(point)].add(end - begin);
+  Spans.push(Ring::Span{
+      .begin = begin, .end = end, .thread = thread_id(), .point = point});
+}
+
+void write_chrome_trace(std::ostream &out) noexcept {
+  // Calibrate ticks against the steady clock over the whole traced run
+  const auto elapsedNs = std::chrono::duration<double, std::nano>(
+                             std::chrono::steady_clock::now() - BaseTime)
+                             .count();
+  const auto elapsedTicks = static_cast<double>(now() - BaseTicks);
+  const auto nsPerTick =
+      elapsedTicks > 0 && elapsedNs > 0 ? elapsedNs / elapsedTicks : 1.0;
+  const auto micros = [nsPerTick](std::uint64_t ticks) noexcept {
+    return static_cast<double>(ticks) * nsPerTick / 1000.0;
+  };
+
+  char number[32];
+  const auto fixed = [&number](double value) noexcept -> const char * {
+    std::snprintf(number, sizeof(number), "%.3f", value);
+    return number;
+  };
+
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  auto first = true;
+  for (const auto &span : Spans.collect()) {
+    out << (first ? "" : ",") << "\n{\"name\":\"" << name(span.point)
+        << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.thread << ",\"ts\":"
+        << fixed(micros(span.begin - BaseTicks));
+    out << ",\"dur\":" << fixed(micros(span.end - span.begin)) << "}";
+    first = false;
+  }
+  out << "\n],\"wuHistograms\":{";
+  first = true;
+  for (auto i = 0uz; i < PointCount; ++i) {
+    const auto &histogram = Histograms[i];
+    const auto count = histogram.total();
+    if (count == 0) {
+      continue;
+    }
+    out << (first ? "" : ",") << "\n\"" << name(static_cast<Point>(i))
+        << "\":{\"count\":" << count;
+    for (const auto &[label, quantile] :
+         {std::pair{"p50", 0.5}, {"p90", 0.9}, {"p99", 0.99}}) {
+      out << ",\"" << label << "_us\":"
+          << fixed(micros(histogram.percentile(quantile)));
+    }
+    out << ",\"max_us\":" << fixed(micros(histogram.max())) << "}";
+    first = false;
+  }
+  out << "\n}}\n";
+}
+} // namespace trace
@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// Build with -DWU_TRACING=0 to compile every trace point out entirely
+#ifndef WU_TRACING
+#define WU_TRACING 1
+#endif
+
+// Span tracing for the hot paths. Spans cost a predictable branch while
+// tracing is off, and two timestamp reads plus a slot in a fixed-size
+// lock-free ring buffer while it's on (`wu --trace FILE`). Every span also
+// feeds a log-linear latency histogram for its trace point.
+namespace trace {
+
+enum class Point : std::uint8_t {
+  AppInit,
+  // connection, extensions and event selection
+  DisplayOpen,
+  DeviceQuery,
+  // press to release
+  Selection,
+  CommandBuild,
+  Spawn,
+  // spawn to reap
+  ChildRun,
+  Apply,
+  Count
+};
+
+auto name(Point point) noexcept -> std::string_view;
+
+namespace detail {
+inline std::atomic<bool> Enabled{false};
+}
+
+inline auto enabled() noexcept -> bool {
+#if WU_TRACING
+  return detail::Enabled.load(std::memory_order_relaxed);
+#else
+  return false;
+#endif
+}
+
+// Raw timestamp: TSC ticks where there is one, steady clock ns otherwise
+inline auto now() noexcept -> std::uint64_t {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return static_cast<std::uint64_t>(
+      std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Starts recording; timestamps are relative to this call
+auto enable() noexcept -> void;
+// Records a span of `point` from `begin` to `end` (both from now())
+auto record(Point point, std::uint64_t begin, std::uint64_t end) noexcept
+    -> void;
+// Writes everything recorded so far as Chrome trace JSON (chrome://tracing,
+// Perfetto). Histogram percentiles go in the "wuHistograms" key.
+auto write_chrome_trace(std::ostream &out) noexcept -> void;
+
+// Records the scope it lives in
+class Span {
+  Point point;
+  std::uint64_t begin;
+
+public:
+  explicit Span(Point point) noexcept
+      : point(point), begin(enabled() ? now() : 0) {}
+  ~Span() noexcept {
+    if (begin != 0) {
+      record(point, begin, now());
+    }
+  }
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+};
+} // namespace trace
+
+#define WU_TRACE_CONCAT_(a, b) a##b
+#define WU_TRACE_CONCAT(a, b) WU_TRACE_CONCAT_(a, b)
+#if WU_TRACING
+#define WU_TRACE_SPAN(point)                                                   \
+  const trace::Span WU_TRACE_CONCAT(traceSpan, __LINE__) { point }
+// For spans that don't fit a scope: WU_TRACE_NOW stores the start in
+// `stamp`, a std::uint64_t, and WU_TRACE_RECORD ends the span there
+#define WU_TRACE_NOW(stamp) (stamp) = trace::enabled() ? trace::now() : 0
+#define WU_TRACE_RECORD(point, stamp)                                          \
+  do {                                                                         \
+    if ((stamp) != 0) {                                                        \
+      trace::record(point, stamp, trace::now());                               \
+    }                                                                          \
+  } while (false)
+#else
+#define WU_TRACE_SPAN(point)                                                   \
+  do {                                                                         \
+  } while (false)
+#define WU_TRACE_NOW(stamp)                                                    \
+  do {                                                                         \
+  } while (false)
+#define WU_TRACE_RECORD(point, stamp)                                          \
+  do {                                                                         \
+  } while (false)
+#endif
@@ -1,71 +1,248 @@
 #include "wacom.h"
-#include "process.h"
+#include "backend.h"
+#include "loop.h"
+#include "trace.h"
 #include "util.h"
+#include "x11.h"
+#include "xinput.h"
 #include <algorithm>
 #include <charconv>
 #include <cstring>
 #include <iterator>
-#include <mutex>
-#include <regex>
-#include <sstream>
 #include <unistd.h>
 
-static std::vector<WacomDevice>
-parse_devices(const std::string &input) noexcept {
-  static std::regex pattern(R"((.+?)\s+id:\s+(\d+))");
-  std::vector<WacomDevice> result{};
-
-  auto begin = std::sregex_iterator(input.begin(), input.end(), pattern);
-  auto end = std::sregex_iterator();
-
-  // Iterate over all matches and print the results
-  for (std::sregex_iterator i = begin; i != end; ++i) {
-    std::smatch match = *i;
-    if (match.size() == 3) { // Full match, name, and id
-      std::string name = match[1].str();
-      std::string id = match[2].str();
-      result.emplace_back(std::move(name), std::move(id));
+using namespace std::string_view_literals;
+
+std::string_view tablet_name(std::string_view deviceName) noexcept {
+  // The wacom driver names its devices "<tablet> Pen stylus", "<tablet> Pen
+  // eraser", "<tablet> Pad pad", "<tablet> Finger touch" and so on.
+  constexpr std::string_view ToolSuffixes[]{"stylus", "eraser", "cursor",
+                                            "touch",  "pad"};
+  const auto last = deviceName.rfind(' ');
+  if (last == std::string_view::npos) {
+    return deviceName;
+  }
+  const auto suffix = deviceName.substr(last + 1);
+  if (std::ranges::find(ToolSuffixes, suffix) == std::end(ToolSuffixes)) {
+    return deviceName;
+  }
+  const auto tool = deviceName.substr(0, last).rfind(' ');
+  return tool == std::string_view::npos ? deviceName
+                                        : deviceName.substr(0, tool);
+}
+
+std::optional<TabletRotation>
+rotation_from_string(std::string_view rotation) noexcept {
+  if (rotation == "none"sv) {
+    return TabletRotation::Upright;
+  } else if (rotation == "cw"sv) {
+    return TabletRotation::Clockwise;
+  } else if (rotation == "ccw"sv) {
+    return TabletRotation::CounterClockwise;
+  } else if (rotation == "half"sv) {
+    return TabletRotation::Half;
+  }
+  return {};
+}
+
+std::string_view to_string(TabletRotation rotation) noexcept {
+  switch (rotation) {
+  case TabletRotation::Upright:
+    return "none";
+  case TabletRotation::Clockwise:
+    return "cw";
+  case TabletRotation::CounterClockwise:
+    return "ccw";
+  case TabletRotation::Half:
+    return "half";
+  }
+  return "none";
+}
+
+std::optional<PressureCurve>
+pressure_curve_from_string(std::string_view curve) noexcept {
+  PressureCurve result{};
+  const auto *it = curve.data();
+  const auto *end = curve.data() + curve.size();
+  for (auto i = 0uz; i < result.size(); ++i) {
+    if (i > 0) {
+      if (it == end || *it != ',') {
+        return {};
+      }
+      ++it;
     }
+    const auto parse = std::from_chars(it, end, result[i]);
+    if (parse.ec != std::errc() || result[i] < 0 || result[i] > 100) {
+      return {};
+    }
+    it = parse.ptr;
+  }
+  if (it != end) {
+    return {};
   }
   return result;
 }
 
-std::optional<std::string> WacomDeviceManager::queryDevices() noexcept {
-  auto &&[data, err] = read(
-      ExecResult::exec("/usr/bin/xsetwacom",
-                       std::span<const std::string>{{"--list", "devices"}}));
-  if (err) {
-    std::cerr << "reading device list failed: " << strerror(err) << std::endl;
-    std::abort();
+static std::optional<int> parse_device_id(std::string_view id) noexcept {
+  int result;
+  const auto parse = std::from_chars(id.data(), id.data() + id.size(), result);
+  if (parse.ec != std::errc() || parse.ptr != id.data() + id.size()) {
+    return {};
   }
-  return data;
+  return result;
 }
 
-void WacomDeviceManager::updateDeviceList() noexcept {
-  if (const auto res = queryDevices(); res) {
-    devices = parse_devices(res.value());
+void WacomDeviceManager::updateDeviceList(const X11Connection *x11) noexcept {
+  WU_TRACE_SPAN(trace::Point::DeviceQuery);
+  if (x11 != nullptr && x11->hasXInput2() && backend().isXDevices()) {
+    devices = xi::enumerate_devices(*x11);
+  } else {
+    devices = backend().enumerate();
   }
+  index.rebuild(devices);
+  snapshots.clear();
+  listed = true;
+}
+
+void WacomDeviceManager::setDeviceSource(const X11Connection *x11) noexcept {
+  deviceSource = x11;
+}
+
+void WacomDeviceManager::setResident(bool resident) noexcept {
+  this->resident = resident;
 }
 
-bool WacomDeviceManager::hasDevice(std::string_view name) const noexcept {
-  for (const auto &[deviceName, id] : devices) {
-    if (deviceName == name || id == name) {
-      return true;
+bool WacomDeviceManager::isResident() const noexcept { return resident; }
+
+void WacomDeviceManager::ensureDeviceList() noexcept {
+  if (!listed) {
+    updateDeviceList(deviceSource);
+  }
+}
+
+void WacomDeviceManager::addDevice(const WacomDevice &device) noexcept {
+  // A new device may re-use the id of one that went away
+  if (const auto id = parse_device_id(device.id); id) {
+    forgetParameters(id.value());
+  }
+  // a deferred list will have it when it's made
+  if (!listed) {
+    return;
+  }
+  const auto it = std::ranges::find(devices, device.id, &WacomDevice::id);
+  if (it != devices.end()) {
+    devices.replace(it - devices.begin(), device);
+  } else {
+    devices.add(device);
+  }
+  index.rebuild(devices);
+}
+
+void WacomDeviceManager::removeDevice(std::string_view id) noexcept {
+  if (const auto deviceId = parse_device_id(id); deviceId) {
+    forgetParameters(deviceId.value());
+  }
+  if (!listed) {
+    return;
+  }
+  devices.remove(id);
+  index.rebuild(devices);
+}
+
+bool WacomDeviceManager::hasDevice(std::string_view name) noexcept {
+  return findDevice(name) != nullptr;
+}
+
+const WacomDevice *
+WacomDeviceManager::findDevice(std::string_view nameOrId) noexcept {
+  ensureDeviceList();
+  return peekDevice(nameOrId);
+}
+
+const WacomDevice *
+WacomDeviceManager::peekDevice(std::string_view nameOrId) const noexcept {
+  const auto i = index.lookup(devices, nameOrId);
+  return i ? &devices[i.value()] : nullptr;
+}
+
+const WacomDevice *WacomDeviceManager::findDevice(
+    std::span<const std::string_view> parts) noexcept {
+  ensureDeviceList();
+  const auto i = index.lookupSquashed(devices, parts);
+  return i ? &devices[i.value()] : nullptr;
+}
+
+DeviceList WacomDeviceManager::getTablet(std::string_view nameOrId) noexcept {
+  const auto device = findDevice(nameOrId);
+  if (device == nullptr) {
+    return {};
+  }
+  const auto tablet = tablet_name(device->deviceName);
+  DeviceList result{};
+  for (const auto &d : devices) {
+    if (tablet_name(d.deviceName) == tablet) {
+      result.add(d);
     }
   }
-  return false;
+  return result;
 }
 
-std::span<const WacomDevice> WacomDeviceManager::getDevices() const noexcept {
+std::span<const WacomDevice> WacomDeviceManager::getDevices() noexcept {
+  ensureDeviceList();
   return devices;
 }
 
+DeviceParameters &WacomDeviceManager::parameters(int deviceId) noexcept {
+  if (auto *params = cachedParameters(deviceId); params) {
+    return *params;
+  }
+  return snapshots.emplace_back(deviceId, DeviceParameters{}).second;
+}
+
+DeviceParameters *
+WacomDeviceManager::cachedParameters(int deviceId) noexcept {
+  const auto it = std::ranges::find(
+      snapshots, deviceId, &std::pair<int, DeviceParameters>::first);
+  return it != snapshots.end() ? &it->second : nullptr;
+}
+
+void WacomDeviceManager::forgetParameters(int deviceId) noexcept {
+  std::erase_if(snapshots, [deviceId](const auto &snapshot) {
+    return snapshot.first == deviceId;
+  });
+}
+
+WacomBackend &WacomDeviceManager::backend() noexcept {
+  return deviceBackend != nullptr ? *deviceBackend
+                                  : XSetWacomBackend::instance();
+}
+
+void WacomDeviceManager::setBackend(WacomBackend &backend) noexcept {
+  deviceBackend = &backend;
+  devices.clear();
+  index.rebuild(devices);
+  snapshots.clear();
+  listed = false;
+}
+
+static thread_local WacomDeviceManager *ScopedManager = nullptr;
+
 /*static*/
 WacomDeviceManager *WacomDeviceManager::getDeviceManager() noexcept {
+  if (ScopedManager != nullptr) {
+    return ScopedManager;
+  }
   static WacomDeviceManager manager{};
   return &manager;
 }
 
+WacomDeviceManager::Scope::Scope(WacomDeviceManager &manager) noexcept
+    : previous(ScopedManager) {
+  ScopedManager = &manager;
+}
+
+WacomDeviceManager::Scope::~Scope() noexcept { ScopedManager = previous; }
+
 std::optional<WacomConfig>
 parse_config(std::span<const std::string_view> args) noexcept {
   if (args.size() == 0) {
@@ -75,37 +252,197 @@ parse_config(std::span<const std::string_view> args) noexcept {
   if (args.size() == 1) {
     return WacomConfig{.deviceName = std::string{args.front()}};
   }
-  const auto len = wu::accumulate(
-      args, [](auto acc, const auto &e) { return acc + e.size(); });
   // user forgot to put name within quotes
-  std::string device_name{};
-  device_name.reserve(len);
-  for (const auto &s : args) {
-    device_name.append(s);
-  }
-
-  if (WacomDeviceManager::getDeviceManager()->hasDevice(device_name)) {
-    return WacomConfig{.deviceName = std::move(device_name)};
+  if (const auto device =
+          WacomDeviceManager::getDeviceManager()->findDevice(args);
+      device) {
+    return WacomConfig{.deviceName = std::string{device->deviceName}};
   } else {
     return {};
   }
 }
 
-CommandResult perform_command(const WacomCommand &command) noexcept {
+void append_commands(std::vector<WacomCommand> &commands,
+                     const WacomConfig &cfg, Selection selection) noexcept {
+  WU_TRACE_SPAN(trace::Point::CommandBuild);
+  commands.push_back(MapToAreaCommand{.config = cfg, .sel = selection});
+  if (cfg.rotation) {
+    commands.push_back(SetRotationCommand{.deviceName = cfg.deviceName,
+                                          .rotation = cfg.rotation.value()});
+  }
+  if (cfg.pressureCurve) {
+    commands.push_back(SetPressureCurveCommand{
+        .deviceName = cfg.deviceName, .curve = cfg.pressureCurve.value()});
+  }
+}
+
+std::string_view command_device(const WacomCommand &command) noexcept {
   return std::visit(
-      [](const MapToAreaCommand &cmd) -> CommandResult {
-        std::vector<std::string> args{};
-        args.reserve(4);
-        args.push_back("set");
-        args.push_back(cmd.config.deviceName);
-        args.push_back("maptooutput");
-        const auto [dimension, origin] = cmd.sel;
-        std::stringstream ss{};
-        ss << dimension.x << "x" << dimension.y << "+" << origin.x << "+"
-           << origin.y;
-        args.push_back(ss.str());
-        const auto result = read(ExecResult::exec("xsetwacom", args));
-        return CommandResult::NotKnown;
+      [](const auto &cmd) noexcept -> std::string_view {
+        if constexpr (requires { cmd.config; }) {
+          return cmd.config.deviceName;
+        } else {
+          return cmd.deviceName;
+        }
       },
       command);
-}
\ No newline at end of file
+}
+
+// Writes `desired` unless the snapshot in `current` says the device already
+// has it. `current` is read first if it isn't known, and ends up holding
+// what the device has, or nothing if the write failed half way.
+template <typename T, typename Read, typename Write>
+static bool apply_parameter(Snapshot<T> &current, const T &desired,
+                            Read &&read, Write &&write) noexcept {
+  if (!current.value) {
+    current.value = read();
+  }
+  if (current.value == desired) {
+    return true;
+  }
+  current.value.reset();
+  if (!write(desired)) {
+    return false;
+  }
+  current.wrote(desired);
+  return true;
+}
+
+static CommandResult native(const X11Connection &x11,
+                            const MapToAreaCommand &cmd) noexcept {
+  const auto deviceId = xi::find_device_id(x11, cmd.config.deviceName);
+  if (!deviceId) {
+    return CommandResult::NotKnown;
+  }
+  const auto id = deviceId.value();
+  auto &params = WacomDeviceManager::getDeviceManager()->parameters(id);
+  if (!params.nativeArea) {
+    // The axis ranges follow the area, so the whole tablet (what keep aspect
+    // crops from, and what undoes an earlier crop) is only known after the
+    // driver resets to it
+    if (!params.area.value) {
+      params.area.value = xi::get_tablet_area(x11, id);
+    }
+    if (!params.area.value) {
+      return CommandResult::NotKnown;
+    }
+    if (!xi::reset_tablet_area(x11, id)) {
+      params.area.value.reset();
+      return CommandResult::Error;
+    }
+    params.nativeArea = xi::get_tablet_area(x11, id);
+    if (!params.nativeArea) {
+      params.area.value.reset();
+      return CommandResult::Error;
+    }
+    params.area.wrote(params.nativeArea.value());
+  }
+  if (!apply_parameter(
+          params.area,
+          cmd.config.keepAspect
+              ? xi::aspect_area(params.nativeArea.value(), cmd.sel.dimensions)
+              : params.nativeArea.value(),
+          [&] { return xi::get_tablet_area(x11, id); },
+          [&](TabletArea area) {
+            return xi::set_tablet_area(x11, id, area);
+          })) {
+    return CommandResult::Error;
+  }
+  if (!apply_parameter(
+          params.matrix, xi::transform_matrix(cmd.sel, x11.screenSize()),
+          [&] { return xi::get_transform_matrix(x11, id); },
+          [&](const TransformMatrix &matrix) {
+            return xi::set_transform_matrix(x11, id, matrix);
+          })) {
+    return CommandResult::NotKnown;
+  }
+  return CommandResult::Ok;
+}
+
+static CommandResult native(const X11Connection &x11,
+                            const SetRotationCommand &cmd) noexcept {
+  const auto deviceId = xi::find_device_id(x11, cmd.deviceName);
+  if (!deviceId) {
+    return CommandResult::NotKnown;
+  }
+  const auto id = deviceId.value();
+  auto &params = WacomDeviceManager::getDeviceManager()->parameters(id);
+  return apply_parameter(
+             params.rotation, cmd.rotation,
+             [&] { return xi::get_rotation(x11, id); },
+             [&](TabletRotation rotation) {
+               return xi::set_rotation(x11, id, rotation);
+             })
+             ? CommandResult::Ok
+             : CommandResult::NotKnown;
+}
+
+static CommandResult native(const X11Connection &x11,
+                            const SetPressureCurveCommand &cmd) noexcept {
+  const auto deviceId = xi::find_device_id(x11, cmd.deviceName);
+  if (!deviceId) {
+    return CommandResult::NotKnown;
+  }
+  const auto id = deviceId.value();
+  auto &params = WacomDeviceManager::getDeviceManager()->parameters(id);
+  return apply_parameter(
+             params.pressureCurve, cmd.curve,
+             [&] { return xi::get_pressure_curve(x11, id); },
+             [&](const PressureCurve &curve) {
+               return xi::set_pressure_curve(x11, id, curve);
+             })
+             ? CommandResult::Ok
+             : CommandResult::NotKnown;
+}
+
+static CommandResult perform_native(const WacomCommand &command,
+                                    const X11Connection &x11) noexcept {
+  return std::visit(
+      [&x11](const auto &cmd) -> CommandResult { return native(x11, cmd); },
+      command);
+}
+
+Task<CommandResult> perform_command(EventLoop &loop, WacomBackend &backend,
+                                    const WacomCommand &command,
+                                    const X11Connection *x11) noexcept {
+  if (x11 != nullptr && x11->hasXInput2() && backend.isXDevices()) {
+    // NotKnown means the device or property isn't reachable through XInput;
+    // let the backend have a go at it instead.
+    if (const auto res = perform_native(command, *x11);
+        res != CommandResult::NotKnown) {
+      co_return res;
+    }
+  }
+  co_return co_await backend.set(loop, command);
+}
+
+std::vector<CommandResult>
+perform_commands(EventLoop &loop, WacomBackend &backend,
+                 std::span<const WacomCommand> commands,
+                 const X11Connection *x11) noexcept {
+  WU_TRACE_SPAN(trace::Point::Apply);
+  std::vector<CommandResult> results(commands.size(), CommandResult::NotKnown);
+  // Native commands are cheap, run them back to back; whatever they can't do
+  // goes to the backend in one batch, which xsetwacom runs concurrently while
+  // `loop` keeps serving its watches.
+  std::vector<WacomCommand> remaining{};
+  std::vector<std::size_t> positions{};
+  const auto native = x11 != nullptr && x11->hasXInput2() &&
+                      backend.isXDevices();
+  for (auto i = 0uz; i < commands.size(); ++i) {
+    if (native) {
+      results[i] = perform_native(commands[i], *x11);
+    }
+    if (results[i] == CommandResult::NotKnown) {
+      remaining.push_back(commands[i]);
+      positions.push_back(i);
+    }
+  }
+  if (!remaining.empty()) {
+    const auto batch = backend.apply(loop, remaining);
+    for (auto i = 0uz; i < batch.size(); ++i) {
+      results[positions[i]] = batch[i];
+    }
+  }
+  return results;
+}
@@ -1,33 +1,173 @@
 #pragma once
+#include "devices.h"
 #include "selection.h"
+#include "task.h"
+#include <array>
+#include <cstdint>
+#include <optional>
 #include <span>
 #include <string>
 #include <variant>
 #include <vector>
 
-struct WacomDevice {
-  std::string deviceName;
-  std::string id;
+struct X11Connection;
+class EventLoop;
+class WacomBackend;
+
+// Name of the physical tablet a tool belongs to, i.e. "Wacom Intuos BT M" for
+// "Wacom Intuos BT M Pen stylus"
+auto tablet_name(std::string_view deviceName) noexcept -> std::string_view;
+
+// Row-major 3x3 "Coordinate Transformation Matrix"
+using TransformMatrix = std::array<float, 9>;
+
+// "Wacom Tablet Area", in tablet units: top left x/y, bottom right x/y
+struct TabletArea {
+  int x1, y1, x2, y2;
+  bool operator==(const TabletArea &) const noexcept = default;
+};
+
+// "Wacom Rotation", values as the driver defines them
+enum class TabletRotation : std::uint8_t {
+  Upright = 0,
+  Clockwise = 1,
+  CounterClockwise = 2,
+  Half = 3
+};
+
+// "Wacom Pressurecurve": the two control points of a bezier curve, x1 y1 x2
+// y2 in 0-100
+using PressureCurve = std::array<int, 4>;
+
+// xsetwacom's names for them: none, cw, ccw, half
+auto rotation_from_string(std::string_view rotation) noexcept
+    -> std::optional<TabletRotation>;
+auto to_string(TabletRotation rotation) noexcept -> std::string_view;
+// "a,b,c,d"
+auto pressure_curve_from_string(std::string_view curve) noexcept
+    -> std::optional<PressureCurve>;
+
+// A device property's value as we last read or wrote it, empty when unknown
+template <typename T> struct Snapshot {
+  std::optional<T> value{};
+  // XI_PropertyEvents our own writes have yet to cause; they confirm the
+  // value instead of invalidating it
+  std::uint32_t ownWrites{0};
+
+  auto wrote(const T &written) noexcept -> void {
+    value = written;
+    ++ownWrites;
+  }
+  // The property changed: forget the value, unless it was our doing
+  auto changed() noexcept -> void {
+    if (ownWrites > 0) {
+      --ownWrites;
+    } else {
+      value.reset();
+    }
+  }
+};
+
+// What we last read from or wrote to a device. Empty fields are unknown,
+// either not read yet or changed behind our back, and get read again before
+// they're compared.
+struct DeviceParameters {
+  // The whole tablet, as the driver resets the area to; fixed for the
+  // device's lifetime
+  std::optional<TabletArea> nativeArea{};
+  Snapshot<TabletArea> area{};
+  Snapshot<TransformMatrix> matrix{};
+  // The same property as `matrix`, as xsetwacom's maptooutput sets it: it
+  // can't be read back, only what we wrote is known
+  Snapshot<Selection> mapping{};
+  Snapshot<TabletRotation> rotation{};
+  Snapshot<PressureCurve> pressureCurve{};
 };
 
 struct WacomConfig {
   std::string deviceName;
+  // Shrink the tablet's active area so it has the same aspect ratio as the
+  // screen area it's mapped to.
+  bool keepAspect{false};
+  // Left as they are when not set
+  std::optional<TabletRotation> rotation{};
+  std::optional<PressureCurve> pressureCurve{};
 };
 
 class WacomDeviceManager {
-  std::vector<WacomDevice> devices{};
-  std::optional<std::string> queryDevices() noexcept;
+  DeviceList devices{};
+  DeviceIndex index{};
+  // Settings snapshot per XInput device id, so re-applying what a device
+  // already has costs nothing
+  std::vector<std::pair<int, DeviceParameters>> snapshots{};
+  // Where the device list comes from, and whether we have it yet
+  const X11Connection *deviceSource{nullptr};
+  bool listed{false};
+  // Outlives a single command line; see setResident
+  bool resident{false};
+  // Lists devices and sets what XInput 2 can't; xsetwacom unless replaced
+  WacomBackend *deviceBackend{nullptr};
+  void ensureDeviceList() noexcept;
 
 public:
   explicit WacomDeviceManager() noexcept = default;
-  void updateDeviceList() noexcept;
-  bool hasDevice(std::string_view name) const noexcept;
-  std::span<const WacomDevice> getDevices() const noexcept;
+  // Enumerates devices through XInput 2 on `x11` when it's available and
+  // the backend's devices are X devices, and through the backend otherwise.
+  void updateDeviceList(const X11Connection *x11 = nullptr) noexcept;
+  // Where the list comes from when a lookup first needs it, see
+  // updateDeviceList. Many runs never need it: a device given by id or exact
+  // name resolves without the list.
+  void setDeviceSource(const X11Connection *x11) noexcept;
+  // Resident processes (daemon, server, auto switch, batch) see the same
+  // devices again, so reading their settings into a snapshot up front pays
+  // off. One-shot runs only compare with what's in the snapshot already.
+  void setResident(bool resident) noexcept;
+  bool isResident() const noexcept;
+  // Patch the device list in place (hotplug). Adding a device with an id we
+  // already know replaces it.
+  void addDevice(const WacomDevice &device) noexcept;
+  void removeDevice(std::string_view id) noexcept;
+  bool hasDevice(std::string_view name) noexcept;
+  // The device with id or name `nameOrId`
+  const WacomDevice *findDevice(std::string_view nameOrId) noexcept;
+  // Like findDevice, but only looks at a list we already have
+  const WacomDevice *peekDevice(std::string_view nameOrId) const noexcept;
+  // The device whose name, with whitespace removed, is `parts` glued together
+  const WacomDevice *findDevice(std::span<const std::string_view> parts) noexcept;
+  // These and the lookups above view into the device list, which hotplug
+  // patches from the event loop: don't hold on to them across a loop run.
+  std::span<const WacomDevice> getDevices() noexcept;
+  // All tools that belong to the same physical tablet as the device named (or
+  // with id) `nameOrId`, in a list of their own that hotplug leaves alone
+  DeviceList getTablet(std::string_view nameOrId) noexcept;
+  WacomBackend &backend() noexcept;
+  // Switches to `backend`, which has to outlive the manager, and drops what
+  // we know about the devices of the previous one
+  void setBackend(WacomBackend &backend) noexcept;
+
+  // The snapshot of device `deviceId`, created empty on first use
+  DeviceParameters &parameters(int deviceId) noexcept;
+  // The snapshot of device `deviceId` if we have one
+  DeviceParameters *cachedParameters(int deviceId) noexcept;
+  void forgetParameters(int deviceId) noexcept;
 
+  // The manager of the display this thread is working for (see Scope), or
+  // the process-wide one
   static WacomDeviceManager *getDeviceManager() noexcept;
+
+  // Makes getDeviceManager() return `manager` on this thread while alive
+  class Scope {
+    WacomDeviceManager *previous;
+
+  public:
+    explicit Scope(WacomDeviceManager &manager) noexcept;
+    ~Scope() noexcept;
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+  };
 };
 
-enum class XSetWacomCommands { MapToArea };
+enum class XSetWacomCommands { MapToArea, Rotate, PressureCurve };
 
 struct MapToAreaCommand {
   WacomConfig config;
@@ -40,11 +180,56 @@ struct MapToAreaCommand {
   auto static constexpr can_verify() noexcept -> bool { return false; }
 };
 
+struct SetRotationCommand {
+  std::string deviceName;
+  TabletRotation rotation;
+
+  auto static constexpr CommandType() noexcept -> XSetWacomCommands {
+    return XSetWacomCommands::Rotate;
+  }
+
+  auto static constexpr can_verify() noexcept -> bool { return false; }
+};
+
+struct SetPressureCurveCommand {
+  std::string deviceName;
+  PressureCurve curve;
+
+  auto static constexpr CommandType() noexcept -> XSetWacomCommands {
+    return XSetWacomCommands::PressureCurve;
+  }
+
+  auto static constexpr can_verify() noexcept -> bool { return false; }
+};
+
 // When adding new commands, add them here
-using WacomCommand = std::variant<MapToAreaCommand>;
+using WacomCommand =
+    std::variant<MapToAreaCommand, SetRotationCommand, SetPressureCurveCommand>;
 
 enum class CommandResult { Ok, Error, NotKnown };
 
+// The device `command` configures
+auto command_device(const WacomCommand &command) noexcept -> std::string_view;
+
 std::optional<WacomConfig>
 parse_config(std::span<const std::string_view> input) noexcept;
-CommandResult perform_command(const WacomCommand &command) noexcept;
\ No newline at end of file
+// Appends the commands that configure `cfg` mapped to `selection`: the
+// mapping itself, followed by rotation and pressure curve when they're set.
+void append_commands(std::vector<WacomCommand> &commands,
+                     const WacomConfig &cfg, Selection selection) noexcept;
+// Performs `command` natively through XInput 2 device properties when `x11`
+// is an open connection and `backend` has X devices, and falls back to the
+// backend otherwise. Natively, properties the device's snapshot says are
+// already set aren't written again. While the backend works (e.g. xsetwacom
+// runs), the awaiting coroutine is suspended on `loop`.
+Task<CommandResult> perform_command(EventLoop &loop, WacomBackend &backend,
+                                    const WacomCommand &command,
+                                    const X11Connection *x11 = nullptr) noexcept;
+// Performs all `commands` at once and returns one result per command, in
+// order. Native commands are cheap and run back to back; whatever has to fall
+// back to the backend goes to it as one batch, and `loop` runs until all of
+// it has finished.
+std::vector<CommandResult>
+perform_commands(EventLoop &loop, WacomBackend &backend,
+                 std::span<const WacomCommand> commands,
+                 const X11Connection *x11 = nullptr) noexcept;
@@ -0,0 +1,108 @@
+#include "x11.h"
+#include <X11/extensions/XInput2.h>
+#include <iterator>
+#include <mutex>
+
+bool X11Connection::isOpen() const noexcept { return display != nullptr; }
+
+void X11Connection::close() noexcept {
+  if (display != nullptr) {
+    XCloseDisplay(display);
+    display = nullptr;
+  }
+}
+
+void X11Connection::queryExtensions() noexcept {
+  int event;
+  int error;
+  if (!XQueryExtension(display, "XInputExtension", &xiOpcode, &event,
+                       &error)) {
+    xiOpcode = -1;
+    return;
+  }
+  int major = 2;
+  int minor = 0;
+  if (XIQueryVersion(display, &major, &minor) != Success) {
+    xiOpcode = -1;
+    return;
+  }
+
+  // One round trip for all of them. Creating the wacom atoms when the driver
+  // hasn't (yet) is harmless, and means a tablet plugged in later still
+  // matches.
+  char *names[]{const_cast<char *>("Wacom Tool Type"),
+                const_cast<char *>("STYLUS"),
+                const_cast<char *>("ERASER"),
+                const_cast<char *>("CURSOR"),
+                const_cast<char *>("TOUCH"),
+                const_cast<char *>("PAD"),
+                const_cast<char *>("Coordinate Transformation Matrix"),
+                const_cast<char *>("Wacom Tablet Area"),
+                const_cast<char *>("Wacom Rotation"),
+                const_cast<char *>("Wacom Pressurecurve"),
+                const_cast<char *>("FLOAT"),
+                const_cast<char *>("Device Node")};
+  Atom atoms[std::size(names)];
+  XInternAtoms(display, names, std::size(names), False, atoms);
+  xiAtoms = XInputAtoms{.toolType = atoms[0],
+                        .stylus = atoms[1],
+                        .eraser = atoms[2],
+                        .cursor = atoms[3],
+                        .touch = atoms[4],
+                        .pad = atoms[5],
+                        .transformMatrix = atoms[6],
+                        .tabletArea = atoms[7],
+                        .rotation = atoms[8],
+                        .pressureCurve = atoms[9],
+                        .floatType = atoms[10],
+                        .deviceNode = atoms[11]};
+}
+
+bool X11Connection::hasXInput2() const noexcept {
+  return isOpen() && xiOpcode != -1;
+}
+
+Vec2 X11Connection::screenSize() const noexcept {
+  return Vec2{.x = DisplayWidth(display, screen),
+              .y = DisplayHeight(display, screen)};
+}
+
+void X11Connection::grabPointer() const noexcept {
+  XGrabPointer(display, root, False,
+               ButtonPressMask | ButtonReleaseMask | PointerMotionMask,
+               GrabModeAsync, GrabModeAsync, None, None, CurrentTime);
+}
+
+void X11Connection::ungrabPointer() const noexcept {
+  XUngrabPointer(display, CurrentTime);
+}
+
+static thread_local int LastError = Success;
+static std::mutex TrapLock{};
+static int Traps = 0;
+static XErrorHandler PreviousHandler = nullptr;
+
+/*static*/ int XErrorTrap::handler(Display *, XErrorEvent *event) noexcept {
+  LastError = event->error_code;
+  return 0;
+}
+
+XErrorTrap::XErrorTrap() noexcept {
+  LastError = Success;
+  std::lock_guard lock{TrapLock};
+  if (Traps++ == 0) {
+    PreviousHandler = XSetErrorHandler(handler);
+  }
+}
+
+XErrorTrap::~XErrorTrap() noexcept {
+  std::lock_guard lock{TrapLock};
+  if (--Traps == 0) {
+    XSetErrorHandler(PreviousHandler);
+  }
+}
+
+bool XErrorTrap::failed(Display *display) const noexcept {
+  XSync(display, False);
+  return LastError != Success;
+}
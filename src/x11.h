@@ -0,0 +1,57 @@
+#pragma once
+#include "selection.h"
+#include <X11/Xlib.h>
+
+// Atoms the XInput backend uses, interned once per connection
+struct XInputAtoms {
+  Atom toolType{None};
+  Atom stylus{None};
+  Atom eraser{None};
+  Atom cursor{None};
+  Atom touch{None};
+  Atom pad{None};
+  Atom transformMatrix{None};
+  Atom tabletArea{None};
+  Atom rotation{None};
+  Atom pressureCurve{None};
+  Atom floatType{None};
+  Atom deviceNode{None};
+};
+
+struct X11Connection {
+  Display *display{nullptr};
+  int screen{0};
+  Window root{0};
+  // Major opcode of the XInputExtension, or -1 if the server does not
+  // support XInput 2.
+  int xiOpcode{-1};
+  XInputAtoms xiAtoms{};
+
+  auto isOpen() const noexcept -> bool;
+  auto close() noexcept -> void;
+  auto queryExtensions() noexcept -> void;
+  auto hasXInput2() const noexcept -> bool;
+  auto screenSize() const noexcept -> Vec2;
+  auto grabPointer() const noexcept -> void;
+  auto ungrabPointer() const noexcept -> void;
+};
+
+// Catches errors raised by the X server while alive, instead of letting
+// Xlib's default handler kill the process over e.g. a BadMatch from a device
+// that doesn't have the property we're writing, or a BadWindow from a window
+// destroyed before our request got to it. The handler is process wide while
+// threads serving different displays trap at the same time, so the first
+// trap installs it, the last puts the previous one back, and every thread
+// sees just the errors of its own requests.
+class XErrorTrap {
+  static int handler(Display *, XErrorEvent *event) noexcept;
+
+public:
+  XErrorTrap() noexcept;
+  ~XErrorTrap() noexcept;
+  XErrorTrap(const XErrorTrap &) = delete;
+  XErrorTrap &operator=(const XErrorTrap &) = delete;
+
+  // Waits for the server to have handled what was sent while trapping
+  auto failed(Display *display) const noexcept -> bool;
+};
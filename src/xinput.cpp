@@ -0,0 +1,379 @@
+#include "xinput.h"
+#include "wacom.h"
+#include <X11/Xatom.h>
+#include <X11/extensions/XInput2.h>
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+
+namespace xi {
+
+TransformMatrix transform_matrix(Selection selection, Vec2 screen) noexcept {
+  const auto [width, height] = selection.dimensions;
+  const auto [x, y] = selection.origin;
+  const auto screenWidth = static_cast<float>(screen.x);
+  const auto screenHeight = static_cast<float>(screen.y);
+  // clang-format off
+  return TransformMatrix{
+    width / screenWidth, 0.0f,                  x / screenWidth,
+    0.0f,                height / screenHeight, y / screenHeight,
+    0.0f,                0.0f,                  1.0f};
+  // clang-format on
+}
+
+TabletArea aspect_area(TabletArea native, Vec2 dimensions) noexcept {
+  if (dimensions.x <= 0 || dimensions.y <= 0) {
+    return native;
+  }
+  const auto nativeWidth = static_cast<double>(native.x2 - native.x1);
+  const auto nativeHeight = static_cast<double>(native.y2 - native.y1);
+  const auto aspect = static_cast<double>(dimensions.x) / dimensions.y;
+  if (nativeWidth / nativeHeight > aspect) {
+    native.x2 = native.x1 + static_cast<int>(nativeHeight * aspect);
+  } else {
+    native.y2 = native.y1 + static_cast<int>(nativeWidth / aspect);
+  }
+  return native;
+}
+
+static std::optional<int> parse_id(std::string_view id) noexcept {
+  int result;
+  const auto parse = std::from_chars(id.data(), id.data() + id.size(), result);
+  if (parse.ec != std::errc() || parse.ptr != id.data() + id.size()) {
+    return {};
+  }
+  return result;
+}
+
+std::optional<int> find_device_id(const X11Connection &x11,
+                                  std::string_view nameOrId) noexcept {
+  if (const auto id = parse_id(nameOrId); id) {
+    return id;
+  }
+  // The device list we already hold knows the id, no need to ask the server.
+  // Don't make one just for this, though; one query is cheaper.
+  if (const auto device =
+          WacomDeviceManager::getDeviceManager()->peekDevice(nameOrId);
+      device) {
+    return parse_id(device->id);
+  }
+
+  int count = 0;
+  auto *devices = XIQueryDevice(x11.display, XIAllDevices, &count);
+  std::optional<int> result{};
+  for (auto i = 0; i < count && !result; ++i) {
+    if (nameOrId == devices[i].name) {
+      result = devices[i].deviceid;
+    }
+  }
+  XIFreeDeviceInfo(devices);
+  return result;
+}
+
+// Reads `N` items of `property`, widened to long whatever their format
+template <std::size_t N>
+static std::optional<std::array<long, N>>
+get_property(const X11Connection &x11, int deviceId, Atom property, Atom type,
+             int format) noexcept {
+  Atom actualType;
+  int actualFormat;
+  unsigned long items;
+  unsigned long remaining;
+  unsigned char *data = nullptr;
+  XErrorTrap trap{};
+  const auto status =
+      XIGetProperty(x11.display, deviceId, property, 0, N, False, type,
+                    &actualType, &actualFormat, &items, &remaining, &data);
+  std::optional<std::array<long, N>> result{};
+  if (status == Success && actualType == type && actualFormat == format &&
+      items == N) {
+    std::array<long, N> values{};
+    for (auto i = 0uz; i < N; ++i) {
+      values[i] = format == 8 ? static_cast<long>(data[i])
+                              : reinterpret_cast<const long *>(data)[i];
+    }
+    result = values;
+  }
+  if (data != nullptr) {
+    XFree(data);
+  }
+  return result;
+}
+
+// Format 8 data is bytes on the client side, format 32 data is longs
+template <std::size_t N, typename T>
+static bool change_property(const X11Connection &x11, int deviceId,
+                            Atom property, Atom type,
+                            std::array<T, N> &data) noexcept {
+  constexpr auto Format = sizeof(T) == 1 ? 8 : 32;
+  XErrorTrap trap{};
+  XIChangeProperty(x11.display, deviceId, property, type, Format,
+                   XIPropModeReplace,
+                   reinterpret_cast<unsigned char *>(data.data()),
+                   static_cast<int>(N));
+  return !trap.failed(x11.display);
+}
+
+std::optional<TransformMatrix> get_transform_matrix(const X11Connection &x11,
+                                                    int deviceId) noexcept {
+  const auto data = get_property<9>(x11, deviceId, x11.xiAtoms.transformMatrix,
+                                    x11.xiAtoms.floatType, 32);
+  if (!data) {
+    return {};
+  }
+  TransformMatrix matrix{};
+  std::transform(data->begin(), data->end(), matrix.begin(), [](long l) {
+    return std::bit_cast<float>(static_cast<std::uint32_t>(l));
+  });
+  return matrix;
+}
+
+std::optional<TabletArea> get_tablet_area(const X11Connection &x11,
+                                          int deviceId) noexcept {
+  const auto data = get_property<4>(x11, deviceId, x11.xiAtoms.tabletArea,
+                                    XA_INTEGER, 32);
+  if (!data) {
+    return {};
+  }
+  const auto [x1, y1, x2, y2] = data.value();
+  return TabletArea{static_cast<int>(x1), static_cast<int>(y1),
+                    static_cast<int>(x2), static_cast<int>(y2)};
+}
+
+std::optional<TabletRotation> get_rotation(const X11Connection &x11,
+                                           int deviceId) noexcept {
+  const auto data =
+      get_property<1>(x11, deviceId, x11.xiAtoms.rotation, XA_INTEGER, 8);
+  if (!data || data->front() < 0 || data->front() > 3) {
+    return {};
+  }
+  return static_cast<TabletRotation>(data->front());
+}
+
+std::optional<PressureCurve> get_pressure_curve(const X11Connection &x11,
+                                                int deviceId) noexcept {
+  const auto data = get_property<4>(x11, deviceId, x11.xiAtoms.pressureCurve,
+                                    XA_INTEGER, 32);
+  if (!data) {
+    return {};
+  }
+  PressureCurve curve{};
+  std::ranges::transform(data.value(), curve.begin(),
+                         [](long l) { return static_cast<int>(l); });
+  return curve;
+}
+
+std::optional<std::string> device_node(const X11Connection &x11,
+                                       int deviceId) noexcept {
+  Atom type;
+  int format;
+  unsigned long items;
+  unsigned long remaining;
+  unsigned char *data = nullptr;
+  XErrorTrap trap{};
+  // Set by the server's udev/hal config backend; a path is well below 1K
+  const auto status =
+      XIGetProperty(x11.display, deviceId, x11.xiAtoms.deviceNode, 0, 256,
+                    False, XA_STRING, &type, &format, &items, &remaining,
+                    &data);
+  std::optional<std::string> result{};
+  if (status == Success && type == XA_STRING && format == 8 && items > 0) {
+    result.emplace(reinterpret_cast<const char *>(data), items);
+    while (!result->empty() && result->back() == '\0') {
+      result->pop_back();
+    }
+  }
+  if (data != nullptr) {
+    XFree(data);
+  }
+  return result;
+}
+
+bool set_transform_matrix(const X11Connection &x11, int deviceId,
+                          const TransformMatrix &matrix) noexcept {
+  // XIChangeProperty reads format 32 data as longs on the client side, but a
+  // float is 32 bits wide on the wire, so widen the bit patterns.
+  std::array<long, 9> data{};
+  std::transform(matrix.begin(), matrix.end(), data.begin(), [](float f) {
+    return static_cast<long>(std::bit_cast<std::uint32_t>(f));
+  });
+  return change_property(x11, deviceId, x11.xiAtoms.transformMatrix,
+                         x11.xiAtoms.floatType, data);
+}
+
+bool set_tablet_area(const X11Connection &x11, int deviceId,
+                     TabletArea area) noexcept {
+  std::array<long, 4> data{area.x1, area.y1, area.x2, area.y2};
+  return change_property(x11, deviceId, x11.xiAtoms.tabletArea, XA_INTEGER,
+                         data);
+}
+
+bool reset_tablet_area(const X11Connection &x11, int deviceId) noexcept {
+  return set_tablet_area(x11, deviceId, TabletArea{-1, -1, -1, -1});
+}
+
+bool set_rotation(const X11Connection &x11, int deviceId,
+                  TabletRotation rotation) noexcept {
+  std::array<unsigned char, 1> data{static_cast<unsigned char>(rotation)};
+  return change_property(x11, deviceId, x11.xiAtoms.rotation, XA_INTEGER,
+                         data);
+}
+
+bool set_pressure_curve(const X11Connection &x11, int deviceId,
+                        const PressureCurve &curve) noexcept {
+  std::array<long, 4> data{curve[0], curve[1], curve[2], curve[3]};
+  return change_property(x11, deviceId, x11.xiAtoms.pressureCurve, XA_INTEGER,
+                         data);
+}
+
+static WacomToolType tool_type(const XInputAtoms &atoms, Atom type) noexcept {
+  if (type == atoms.stylus) {
+    return WacomToolType::Stylus;
+  } else if (type == atoms.eraser) {
+    return WacomToolType::Eraser;
+  } else if (type == atoms.cursor) {
+    return WacomToolType::Cursor;
+  } else if (type == atoms.touch) {
+    return WacomToolType::Touch;
+  } else if (type == atoms.pad) {
+    return WacomToolType::Pad;
+  }
+  return WacomToolType::Unknown;
+}
+
+// The tool type of `deviceId`, or nothing if it isn't driven by the wacom
+// driver.
+static std::optional<WacomToolType>
+wacom_tool_type(const X11Connection &x11, int deviceId) noexcept {
+  Atom type;
+  int format;
+  unsigned long items;
+  unsigned long remaining;
+  unsigned char *data = nullptr;
+  XErrorTrap trap{};
+  const auto status =
+      XIGetProperty(x11.display, deviceId, x11.xiAtoms.toolType, 0, 1, False,
+                    XA_ATOM, &type, &format, &items, &remaining, &data);
+  std::optional<WacomToolType> result{};
+  if (status == Success && type == XA_ATOM && format == 32 && items == 1) {
+    result = tool_type(x11.xiAtoms, *reinterpret_cast<Atom *>(data));
+  }
+  if (data != nullptr) {
+    XFree(data);
+  }
+  return result;
+}
+
+static bool is_slave(const XIDeviceInfo &info) noexcept {
+  return info.use == XISlavePointer || info.use == XIFloatingSlave;
+}
+
+DeviceList enumerate_devices(const X11Connection &x11) noexcept {
+  int count = 0;
+  auto *devices = XIQueryDevice(x11.display, XIAllDevices, &count);
+  DeviceList result{};
+  for (auto i = 0; i < count; ++i) {
+    if (!is_slave(devices[i])) {
+      continue;
+    }
+    if (const auto type = wacom_tool_type(x11, devices[i].deviceid); type) {
+      const auto id = std::to_string(devices[i].deviceid);
+      result.add(WacomDevice{
+          .deviceName = devices[i].name, .id = id, .type = type.value()});
+    }
+  }
+  XIFreeDeviceInfo(devices);
+  return result;
+}
+
+DeviceList query_device(const X11Connection &x11, int deviceId) noexcept {
+  int count = 0;
+  XErrorTrap trap{};
+  auto *info = XIQueryDevice(x11.display, deviceId, &count);
+  if (info == nullptr) {
+    return {};
+  }
+  DeviceList result{};
+  if (count == 1 && is_slave(info[0])) {
+    if (const auto type = wacom_tool_type(x11, deviceId); type) {
+      const auto id = std::to_string(deviceId);
+      result.add(WacomDevice{
+          .deviceName = info[0].name, .id = id, .type = type.value()});
+    }
+  }
+  XIFreeDeviceInfo(info);
+  return result;
+}
+
+void select_device_events(const X11Connection &x11) noexcept {
+  unsigned char bits[XIMaskLen(XI_LASTEVENT)]{};
+  XISetMask(bits, XI_HierarchyChanged);
+  XISetMask(bits, XI_PropertyEvent);
+  XIEventMask mask{
+      .deviceid = XIAllDevices, .mask_len = sizeof(bits), .mask = bits};
+  XISelectEvents(x11.display, x11.root, &mask, 1);
+  XFlush(x11.display);
+}
+
+static void handle_hierarchy_event(const X11Connection &x11,
+                                   const XIHierarchyEvent &hierarchy,
+                                   WacomDeviceManager &manager) noexcept {
+  for (auto i = 0; i < hierarchy.num_info; ++i) {
+    const auto &info = hierarchy.info[i];
+    if (info.flags & (XISlaveRemoved | XIDeviceDisabled)) {
+      manager.removeDevice(std::to_string(info.deviceid));
+    } else if (info.flags & (XISlaveAdded | XIDeviceEnabled)) {
+      if (const auto device = query_device(x11, info.deviceid);
+          !device.empty()) {
+        manager.addDevice(device[0]);
+      }
+    }
+  }
+}
+
+// Someone, possibly us, changed a property. Whatever the new value is, it's
+// read again when it's next needed.
+static void handle_property_event(const X11Connection &x11,
+                                  const XIPropertyEvent &event,
+                                  WacomDeviceManager &manager) noexcept {
+  auto *params = manager.cachedParameters(event.deviceid);
+  if (params == nullptr) {
+    return;
+  }
+  // Our own writes cause these too; those leave the snapshot as it is
+  const auto &atoms = x11.xiAtoms;
+  if (event.property == atoms.tabletArea) {
+    params->area.changed();
+  } else if (event.property == atoms.transformMatrix) {
+    params->matrix.changed();
+    params->mapping.changed();
+  } else if (event.property == atoms.rotation) {
+    params->rotation.changed();
+  } else if (event.property == atoms.pressureCurve) {
+    params->pressureCurve.changed();
+  }
+}
+
+bool handle_device_event(const X11Connection &x11, XEvent &event,
+                         WacomDeviceManager &manager) noexcept {
+  auto *cookie = &event.xcookie;
+  if (cookie->type != GenericEvent || cookie->extension != x11.xiOpcode ||
+      (cookie->evtype != XI_HierarchyChanged &&
+       cookie->evtype != XI_PropertyEvent)) {
+    return false;
+  }
+  if (!XGetEventData(x11.display, cookie)) {
+    return true;
+  }
+  if (cookie->evtype == XI_HierarchyChanged) {
+    handle_hierarchy_event(
+        x11, *static_cast<const XIHierarchyEvent *>(cookie->data), manager);
+  } else {
+    handle_property_event(
+        x11, *static_cast<const XIPropertyEvent *>(cookie->data), manager);
+  }
+  XFreeEventData(x11.display, cookie);
+  return true;
+}
+} // namespace xi
@@ -0,0 +1,75 @@
+#pragma once
+#include "selection.h"
+#include "wacom.h"
+#include "x11.h"
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Native backend that talks to the wacom X driver through XInput 2 device
+// properties on our own X connection, instead of spawning xsetwacom (which
+// opens its own connection just to write the very same properties).
+namespace xi {
+
+using ::TabletArea;
+using ::TransformMatrix;
+
+// Matrix that maps the full tablet onto `selection` on a screen of
+// `screen` pixels.
+auto transform_matrix(Selection selection, Vec2 screen) noexcept
+    -> TransformMatrix;
+
+// Largest sub-area of `native`, anchored at its top left corner, that has the
+// same aspect ratio as `dimensions`.
+auto aspect_area(TabletArea native, Vec2 dimensions) noexcept -> TabletArea;
+
+// Resolves a device id ("12") or device name to the XInput device id.
+auto find_device_id(const X11Connection &x11, std::string_view nameOrId) noexcept
+    -> std::optional<int>;
+
+// Current property values, or nothing if the device doesn't have them
+auto get_transform_matrix(const X11Connection &x11, int deviceId) noexcept
+    -> std::optional<TransformMatrix>;
+auto get_tablet_area(const X11Connection &x11, int deviceId) noexcept
+    -> std::optional<TabletArea>;
+auto get_rotation(const X11Connection &x11, int deviceId) noexcept
+    -> std::optional<TabletRotation>;
+auto get_pressure_curve(const X11Connection &x11, int deviceId) noexcept
+    -> std::optional<PressureCurve>;
+
+// The evdev node the server reads the device from, e.g. /dev/input/event12
+auto device_node(const X11Connection &x11, int deviceId) noexcept
+    -> std::optional<std::string>;
+
+// Write properties, then sync once to pick up any error the server raised.
+auto set_transform_matrix(const X11Connection &x11, int deviceId,
+                          const TransformMatrix &matrix) noexcept -> bool;
+auto set_tablet_area(const X11Connection &x11, int deviceId,
+                     TabletArea area) noexcept -> bool;
+// Back to the whole tablet, which the driver does for an area of all -1 (as
+// xsetwacom's ResetArea sends); get_tablet_area then reads what that is.
+auto reset_tablet_area(const X11Connection &x11, int deviceId) noexcept
+    -> bool;
+auto set_rotation(const X11Connection &x11, int deviceId,
+                  TabletRotation rotation) noexcept -> bool;
+auto set_pressure_curve(const X11Connection &x11, int deviceId,
+                        const PressureCurve &curve) noexcept -> bool;
+
+// All wacom tools known to the server: every slave device that carries the
+// driver's "Wacom Tool Type" property.
+auto enumerate_devices(const X11Connection &x11) noexcept -> DeviceList;
+// A list of just `deviceId` if it is a wacom tool, and an empty one if not
+auto query_device(const X11Connection &x11, int deviceId) noexcept
+    -> DeviceList;
+
+// Ask for XI_HierarchyChanged and XI_PropertyEvent events on the root window
+auto select_device_events(const X11Connection &x11) noexcept -> void;
+// If `event` is an XI_HierarchyChanged event, patches the device list of
+// `manager` with the devices that were added or removed. If it's an
+// XI_PropertyEvent for a property we snapshot, forgets the snapshotted value
+// unless the event is the echo of our own write. Returns true for both.
+auto handle_device_event(const X11Connection &x11, XEvent &event,
+                         WacomDeviceManager &manager) noexcept -> bool;
+} // namespace xi